@@ -0,0 +1,365 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFCHECKPOINT_H
+#define BFCHECKPOINT_H
+
+#include <signal.h>
+
+#include "commons.h"
+
+#ifdef POSIX_SYSTEM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+#define CHECKPOINT_MAGIC    "BFCK"
+#define CHECKPOINT_VERSION  1
+
+/**
+ * Header of a checkpoint file.
+ * It is followed by ranges of memory, each an int start, an int length,
+ * and length bytes of memory.
+ */
+typedef struct Checkpoint {
+    char magic[4];
+    int version;
+    int memorySize;
+    int processedFileSize;
+    unsigned int programHash;   // hash of pre-processed source the checkpoint belongs to
+    int pointer;
+    int filePointer;            // next operation to be performed
+    long long inputOffset;      // characters read from stdin
+    long long outputOffset;     // characters written to stdout
+    int rangeCount;
+} Checkpoint;
+
+// path to the checkpoint file to write, or NULL
+char* checkpointPath = NULL;
+
+// path to the checkpoint file to resume from, or NULL
+char* resumePath = NULL;
+
+// seconds between periodic checkpoints
+int checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+
+// set by signals when a checkpoint is to be written
+volatile sig_atomic_t checkpointRequested = 0;
+
+#ifdef POSIX_SYSTEM
+
+// process writing the last checkpoint, or 0
+pid_t checkpointWriter = 0;
+
+// path the checkpoint is written to before it replaces the previous one
+char* checkpointTempPath = NULL;
+
+// memory pages to be written, filled in by the process writing a checkpoint
+unsigned char* checkpointPages = NULL;
+
+/**
+ * Hash the pre-processed source so that checkpoints are only resumed
+ * with the same program and optimizations.
+ */
+unsigned int hashProgram() {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < processedFileSize; i++) {
+        hash = (hash ^ (unsigned char) processed[i]) * 16777619u;
+        hash = (hash ^ (unsigned int) jumps[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Request a checkpoint from a signal handler.
+ */
+void requestCheckpoint(int signal) {
+    (void) signal;
+    checkpointRequested = 1;
+}
+
+/**
+ * Write all bytes to a file descriptor.
+ * Returns 0 on failure.
+ */
+int writeFully(int fd, const void* buffer, size_t length) {
+    const char* bytes = (const char*) buffer;
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written <= 0) return 0;
+        bytes += written;
+        length -= written;
+    }
+    return 1;
+}
+
+/**
+ * Test if memory is all zeros.
+ */
+static inline int isZeroMemory(const unsigned char* start, long length) {
+    for (long i = 0; i < length; i++) {
+        if (start[i] != 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Write the checkpoint file.
+ * Only memory pages which were ever touched and are not all zeros are
+ * written, including pages swapped out since they were touched.
+ * Runs in a forked process using only system calls, with its path and
+ * page buffer prepared by initCheckpoints().
+ */
+int writeCheckpointFile(Checkpoint* checkpoint) {
+    const char* tempPath = checkpointTempPath;
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return 0;
+
+    // find touched pages, or check all pages if touched pages are unknown
+    long pageSize = memoryPageSize;
+    long pages = memoryPageCount;
+    unsigned char* written = checkpointPages;
+    if (!findTouchedPages(written)) {
+        for (long i = 0; i < pages; i++) written[i] = 1;
+    }
+
+    // zero pages are restored by resuming without being written
+    for (long i = 0; i < pages; i++) {
+        long length = (i + 1) * pageSize < MEMORY_SIZE ? pageSize : MEMORY_SIZE - i * pageSize;
+        if (written[i] && isZeroMemory(memory + i * pageSize, length)) written[i] = 0;
+    }
+
+    // find ranges of pages to be written
+    checkpoint->rangeCount = 0;
+    for (long i = 0; i < pages; i++) {
+        if (written[i] && (i == 0 || !written[i - 1])) checkpoint->rangeCount++;
+    }
+
+    int success = writeFully(fd, checkpoint, sizeof(Checkpoint));
+    for (long i = 0; i < pages && success; i++) {
+        if (written[i] && (i == 0 || !written[i - 1])) {
+            long j = i;
+            while (j < pages && written[j]) j++;
+
+            int start = i * pageSize;
+            int length = (j * pageSize < MEMORY_SIZE ? j * pageSize : MEMORY_SIZE) - start;
+            success = writeFully(fd, &start, sizeof(int))
+                && writeFully(fd, &length, sizeof(int))
+                && writeFully(fd, memory + start, length);
+        }
+    }
+
+    // replace the previous checkpoint only once complete
+    success = close(fd) == 0 && success;
+    return success && rename(tempPath, checkpointPath) == 0;
+}
+
+/**
+ * Write a checkpoint of the execution asynchronously.
+ * A forked process writes its copy of memory while execution continues.
+ * The checkpoint is skipped if the previous one is still being written.
+ */
+void writeCheckpoint() {
+    checkpointRequested = 0;
+    alarm(checkpointInterval);
+
+    // skip if the previous checkpoint is still being written
+    if (checkpointWriter != 0) {
+        if (waitpid(checkpointWriter, NULL, WNOHANG) == 0) return;
+        checkpointWriter = 0;
+    }
+
+    Checkpoint checkpoint;
+    memcpy(checkpoint.magic, CHECKPOINT_MAGIC, 4);
+    checkpoint.version = CHECKPOINT_VERSION;
+    checkpoint.memorySize = MEMORY_SIZE;
+    checkpoint.processedFileSize = processedFileSize;
+    checkpoint.programHash = hashProgram();
+    checkpoint.pointer = pointer;
+    checkpoint.filePointer = filePointer;
+    checkpoint.inputOffset = inputOffset;
+    checkpoint.outputOffset = outputOffset;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(writeCheckpointFile(&checkpoint) ? 0 : 1);
+    }
+    else if (pid > 0) {
+        checkpointWriter = pid;
+    }
+    else {
+        fprintf(stderr, "Failed to write checkpoint: %s\n", checkpointPath);
+    }
+}
+
+/**
+ * Initialize periodic checkpoints and checkpoints on SIGUSR1.
+ * Everything the forked writer needs from libc is prepared here.
+ */
+void initCheckpoints() {
+    checkpointTempPath = (char*) malloc(sizeof(char) * (strlen(checkpointPath) + 5));
+    sprintf(checkpointTempPath, "%s.tmp", checkpointPath);
+    checkpointPages = (unsigned char*) malloc(sizeof(unsigned char) * (memoryPageCount));
+
+    signal(SIGUSR1, requestCheckpoint);
+    signal(SIGALRM, requestCheckpoint);
+    alarm(checkpointInterval);
+}
+
+/**
+ * Read exactly length bytes from a file, exiting on failure.
+ */
+void readCheckpointFully(FILE* fp, void* buffer, size_t length, const char* filePath) {
+    if (fread(buffer, 1, length, fp) != length) {
+        // display error message and exit
+        fprintf(stderr, "Error reading checkpoint file: %s\n", filePath);
+        exit(1);
+    }
+}
+
+/**
+ * Resume execution from a checkpoint file.
+ * Input already read is skipped, and output written after the checkpoint
+ * is truncated if stdout is a regular file.
+ */
+void resumeCheckpoint(const char* filePath) {
+    FILE* fp = fopen(filePath, "rb");
+
+    if (fp == NULL) {
+        // display error message and exit
+        fprintf(stderr, "Checkpoint file not found: %s\n", filePath);
+        exit(1);
+    }
+
+    Checkpoint checkpoint;
+    readCheckpointFully(fp, &checkpoint, sizeof(Checkpoint), filePath);
+
+    if (memcmp(checkpoint.magic, CHECKPOINT_MAGIC, 4) != 0 || checkpoint.version != CHECKPOINT_VERSION) {
+        // display error message and exit
+        fprintf(stderr, "Invalid checkpoint file: %s\n", filePath);
+        exit(1);
+    }
+
+    if (checkpoint.memorySize != MEMORY_SIZE || checkpoint.processedFileSize != processedFileSize
+            || checkpoint.programHash != hashProgram()) {
+        // display error message and exit
+        fprintf(stderr, "Checkpoint does not belong to this program, memory size, and optimizations: %s\n", filePath);
+        exit(1);
+    }
+
+    if (checkpoint.pointer < 0 || checkpoint.pointer >= MEMORY_SIZE
+            || checkpoint.filePointer < 0 || checkpoint.filePointer > processedFileSize
+            || checkpoint.inputOffset < 0 || checkpoint.outputOffset < 0) {
+        // display error message and exit
+        fprintf(stderr, "Invalid checkpoint file: %s\n", filePath);
+        exit(1);
+    }
+
+    // restore touched memory
+    for (int i = 0; i < checkpoint.rangeCount; i++) {
+        int start, length;
+        readCheckpointFully(fp, &start, sizeof(int), filePath);
+        readCheckpointFully(fp, &length, sizeof(int), filePath);
+        if (start < 0 || length < 0 || length > MEMORY_SIZE - start) {
+            // display error message and exit
+            fprintf(stderr, "Invalid checkpoint file: %s\n", filePath);
+            exit(1);
+        }
+        readCheckpointFully(fp, memory + start, length, filePath);
+    }
+    fclose(fp);
+
+    pointer = checkpoint.pointer;
+    filePointer = checkpoint.filePointer;
+
+    // skip input already read
+    inputOffset = checkpoint.inputOffset;
+    if (fseek(stdin, checkpoint.inputOffset, SEEK_SET) != 0) {
+        for (long long i = 0; i < checkpoint.inputOffset && getchar() != EOF; i++);
+    }
+
+    // drop output written after the checkpoint
+    outputOffset = checkpoint.outputOffset;
+    fflush(stdout);
+    if (lseek(fileno(stdout), checkpoint.outputOffset, SEEK_SET) != -1) {
+        if (ftruncate(fileno(stdout), checkpoint.outputOffset) != 0) {
+            fprintf(stderr, "Failed to truncate output to checkpoint\n");
+        }
+    }
+}
+
+/**
+ * Clean up checkpoints.
+ * Waits for the last checkpoint to be written.
+ */
+static inline void cleanupCheckpoints() {
+    if (checkpointWriter != 0) {
+        waitpid(checkpointWriter, NULL, 0);
+        checkpointWriter = 0;
+    }
+
+    // free the path and page buffer of the writer
+    if (checkpointTempPath != NULL) {
+        free(checkpointTempPath);
+        checkpointTempPath = NULL;
+    }
+    if (checkpointPages != NULL) {
+        free(checkpointPages);
+        checkpointPages = NULL;
+    }
+}
+
+#else
+
+/**
+ * Initialize periodic checkpoints and checkpoints on SIGUSR1.
+ * Checkpoints are written by a forked process, which is only possible on POSIX systems.
+ */
+void initCheckpoints() {
+    // display error message and exit
+    fprintf(stderr, "Checkpoints are not supported on this system\n");
+    exit(1);
+}
+
+/**
+ * Write a checkpoint.
+ */
+void writeCheckpoint() {
+}
+
+/**
+ * Resume execution from a checkpoint file.
+ */
+void resumeCheckpoint(const char* filePath) {
+    // display error message and exit
+    fprintf(stderr, "Checkpoints are not supported on this system: %s\n", filePath);
+    exit(1);
+}
+
+/**
+ * Clean up checkpoints.
+ */
+static inline void cleanupCheckpoints() {
+}
+
+#endif
+
+#endif // BFCHECKPOINT_H
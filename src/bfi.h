@@ -21,18 +21,130 @@
 #define BFI_H
 
 #include "commons.h"
+#include "bfpipe.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Find the position of the cell at an offset from the pointer, wrapping around the memory.
+ * The position is computed unsigned, as it overflows an int with large memory,
+ * and a position below zero wraps to one above the memory.
+ */
+static inline int cellAt(int offset) {
+    unsigned int position = (unsigned int) pointer + (unsigned int) offset;
+    if (position >= (unsigned int) MEMORY_SIZE) position += offset < 0 ? MEMORY_SIZE : -MEMORY_SIZE;
+    return position;
+}
+
+/**
+ * Move the pointer by sum, wrapping around the memory.
+ */
+static inline void movePointer(int sum) {
+    pointer = cellAt(sum);
+}
+
+/**
+ * Update a window of cells starting at the pointer to (cell & keep) + add.
+ * The window is updated 32 or 16 cells at a time with AVX2 or SSE2 if the
+ * interpreter was built for them, and one cell at a time otherwise.
+ */
+static inline void updateRun(const unsigned char* add, const unsigned char* keep, int length) {
+    // window wraps around the memory
+    if (length > MEMORY_SIZE - pointer) {
+        for (int i = 0; i < length; i++) {
+            int position = cellAt(i);
+            memory[position] = (memory[position] & keep[i]) + add[i];
+        }
+        return;
+    }
+
+    unsigned char* cells = memory + pointer;
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i value = _mm256_loadu_si256((const __m256i*) (cells + i));
+        value = _mm256_and_si256(value, _mm256_loadu_si256((const __m256i*) (keep + i)));
+        value = _mm256_add_epi8(value, _mm256_loadu_si256((const __m256i*) (add + i)));
+        _mm256_storeu_si256((__m256i*) (cells + i), value);
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i*) (cells + i));
+        value = _mm_and_si128(value, _mm_loadu_si128((const __m128i*) (keep + i)));
+        value = _mm_add_epi8(value, _mm_loadu_si128((const __m128i*) (add + i)));
+        _mm_storeu_si128((__m128i*) (cells + i), value);
+    }
+#endif
+    for (; i < length; i++) {
+        cells[i] = (cells[i] & keep[i]) + add[i];
+    }
+}
+
+/**
+ * Read the offsets of the cells of an affine loop from its data.
+ */
+static inline void readAffineOffsets(const unsigned char* data, int size, int* offsets) {
+    memcpy(offsets, data, sizeof(int) * size);
+}
+
+/**
+ * Apply the map of an affine loop to its cells as many times as the loop runs.
+ * The loop runs its counter, the first cell, times a factor times, so the
+ * powers of two of the map are applied for the bits of the trip count.
+ */
+static inline void applyAffineLoop(const unsigned char* data, int size, unsigned char* cells) {
+    int count = (cells[0] * data[sizeof(int) * size]) & 0xFF;
+    const unsigned char* power = data + sizeof(int) * size + 1;
+    unsigned char next[MAX_LOOP_CELLS];
+
+    for (; count != 0; count >>= 1, power += size * (size + 1)) {
+        if (count & 1) {
+            for (int i = 0; i < size; i++) {
+                const unsigned char* row = power + i * (size + 1);
+                unsigned char value = row[size];
+                for (int j = 0; j < size; j++) {
+                    value += row[j] * cells[j];
+                }
+                next[i] = value;
+            }
+            memcpy(cells, next, size);
+        }
+    }
+}
+
+/**
+ * Run an affine loop on the cells around the pointer.
+ */
+static inline void affineLoop(const unsigned char* data, int size) {
+    int offsets[MAX_LOOP_CELLS];
+    unsigned char cells[MAX_LOOP_CELLS] = { 0 };
+    readAffineOffsets(data, size, offsets);
+
+    for (int i = 0; i < size; i++) {
+        offsets[i] = cellAt(offsets[i]);
+        cells[i] = memory[offsets[i]];
+    }
+    applyAffineLoop(data, size, cells);
+    for (int i = 0; i < size; i++) {
+        memory[offsets[i]] = cells[i];
+    }
+}
 
 /**
  * Perform the operation represented by the character.
  * Ignore character if it is not an operator.
+ * It is called from several dispatch loops, and must be inlined into each
+ * of them, as a call per operation costs a third of the execution time.
  */
-static inline void doOperation(char ch) {
+static inline __attribute__((always_inline)) void doOperation(char ch) {
     // handle pointer movement (> and <)
     if (ch == ADDRESS) {
-        int sum = jumps[filePointer - 1];
-        pointer += sum;
-        if (pointer >= MEMORY_SIZE) pointer -= MEMORY_SIZE;
-        else if (pointer < 0) pointer += MEMORY_SIZE;
+        movePointer(jumps[filePointer - 1]);
     }
 
     // handle value update (+ and -)
@@ -43,13 +155,20 @@ static inline void doOperation(char ch) {
 
     // handle output (.)
     else if (ch == '.') {
-        printf("%c", memory[pointer]);
-        fflush(stdout);
+        if (pipelineFlag) {
+            pipeOutput(memory[pointer]);
+        }
+        else {
+            printf("%c", memory[pointer]);
+            fflush(stdout);
+        }
+        outputOffset++;
     }
 
     // handle input (,)
     else if (ch == ',') {
-        memory[pointer] = getchar();
+        memory[pointer] = pipelineFlag ? pipeInput() : getchar();
+        inputOffset++;
     }
 
     // handle [-]
@@ -80,6 +199,117 @@ static inline void doOperation(char ch) {
             filePointer = jumps[filePointer - 1] + 1;
         }
     }
+
+    // handle set(value)
+    else if (ch == SET_VALUE) {
+        memory[pointer] = jumps[filePointer - 1];
+    }
+
+    // handle output of constants
+    else if (ch == OUTPUT_CONST) {
+        if (pipelineFlag) {
+            for (int i = 0; i < operands[filePointer - 1]; i++) {
+                pipeOutput(constants[jumps[filePointer - 1] + i]);
+            }
+        }
+        else {
+            fwrite(constants + jumps[filePointer - 1], sizeof(unsigned char), operands[filePointer - 1], stdout);
+            fflush(stdout);
+        }
+        outputOffset += operands[filePointer - 1];
+    }
+
+    // handle update of a run of cells
+    else if (ch == UPDATE_RUN) {
+        int length = operands[filePointer - 1];
+        unsigned char* add = constants + jumps[filePointer - 1];
+        updateRun(add, add + length, length);
+    }
+
+    // handle multiply-add of the current cell into the cell at an offset
+    else if (ch == MULTIPLY_ADD) {
+        memory[cellAt(jumps[filePointer - 1])] += memory[pointer] * operands[filePointer - 1];
+    }
+
+    // handle loop whose iteration is an affine map of its cells
+    else if (ch == AFFINE_LOOP) {
+        affineLoop(constants + jumps[filePointer - 1], operands[filePointer - 1]);
+    }
+
+    // handle loop opening which runs at most once
+    // the matching closing is removed by fuseOperations()
+    else if (ch == IF_OPEN) {
+        if (memory[pointer] == 0) {
+            filePointer = jumps[filePointer - 1] + 1;
+        }
+    }
+
+    // handle >+ superinstruction
+    else if (ch == ADDRESS_DATA) {
+        movePointer(jumps[filePointer - 1]);
+        memory[pointer] += operands[filePointer - 1];
+    }
+
+    // handle +> superinstruction
+    else if (ch == DATA_ADDRESS) {
+        memory[pointer] += operands[filePointer - 1];
+        movePointer(jumps[filePointer - 1]);
+    }
+
+    // handle >[-] superinstruction
+    else if (ch == ADDRESS_SET_ZERO) {
+        movePointer(jumps[filePointer - 1]);
+        memory[pointer] = 0;
+    }
+
+    // handle >set(value) superinstruction
+    else if (ch == ADDRESS_SET_VALUE) {
+        movePointer(jumps[filePointer - 1]);
+        memory[pointer] = operands[filePointer - 1];
+    }
+
+    // handle >[ superinstruction
+    else if (ch == ADDRESS_LOOP_OPEN) {
+        movePointer(operands[filePointer - 1]);
+        if (memory[pointer] == 0) {
+            filePointer = jumps[filePointer - 1] + 1;
+        }
+    }
+
+    // handle >] superinstruction
+    else if (ch == ADDRESS_LOOP_CLOSE) {
+        movePointer(operands[filePointer - 1]);
+        if (memory[pointer] != 0) {
+            filePointer = jumps[filePointer - 1] + 1;
+        }
+    }
+
+    // handle >[>>>] superinstruction
+    else if (ch == ADDRESS_SCAN_ZERO) {
+        movePointer(operands[filePointer - 1]);
+        while (memory[pointer] != 0) {
+            movePointer(jumps[filePointer - 1]);
+        }
+    }
+
+    // handle multiply-add followed by [-] superinstruction
+    else if (ch == MULTIPLY_ADD_SET_ZERO) {
+        memory[cellAt(jumps[filePointer - 1])] += memory[pointer] * operands[filePointer - 1];
+        memory[pointer] = 0;
+    }
+
+    // handle [+> superinstruction
+    // the +> stays in place after it so that ] can jump back to it
+    else if (ch == LOOP_DATA_ADDRESS) {
+        if (memory[pointer] == 0) {
+            filePointer = jumps[filePointer - 1] + 1;
+        }
+        else {
+            memory[pointer] += operands[filePointer];
+            movePointer(jumps[filePointer]);
+            filePointer++;
+        }
+    }
 }
 
 #endif // BFI_H
@@ -0,0 +1,356 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFJIT_H
+#define BFJIT_H
+
+#include "commons.h"
+#include "bfi.h"
+#include "bftoc.h"
+
+#ifdef POSIX_SYSTEM
+
+#include <pthread.h>
+#include <dlfcn.h>
+#include <unistd.h>
+
+typedef void (*NativeLoop)(unsigned char* memory, int* pointer);
+
+// native loops indexed by position of their [ in pre-processed source
+NativeLoop* nativeLoops = NULL;
+
+// number of times each loop was entered or iterated
+// counting stops at HOT_LOOP_THRESHOLD once the loop is queued to be compiled
+int* loopCounts = NULL;
+
+// directory holding the generated C files and shared objects
+char nativeDirectory[] = "/tmp/brainfuck-XXXXXX";
+int nativeDirectoryCreated = 0;
+
+// handles of loaded shared objects
+void** nativeLibraries = NULL;
+int nativeLibraryCount = 0;
+
+// hot loops waiting to be compiled
+int hotLoops[MAX_HOT_LOOPS];
+int hotLoopCount = 0;
+
+// background compiler thread
+pthread_t compilerThread;
+pthread_mutex_t compilerMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compilerCondition = PTHREAD_COND_INITIALIZER;
+int compilerRunning = 0;
+int compilerStopping = 0;
+
+/**
+ * Translate loops to C, compile them into a shared object, and load them.
+ * Returns 0 if the loops could not be compiled, or some of them not loaded.
+ */
+int compileLoops(int* positions, int count) {
+    // every loop is queued once, so there are at most as many shared objects as loops
+    if (nativeLibraryCount == processedFileSize) {
+        return 0;
+    }
+
+    char cPath[sizeof(nativeDirectory) + 32];
+    char soPath[sizeof(nativeDirectory) + 32];
+    sprintf(cPath, "%s/loops%d.c", nativeDirectory, nativeLibraryCount);
+    sprintf(soPath, "%s/loops%d.so", nativeDirectory, nativeLibraryCount);
+
+    // translate each loop from its [ to its ] into a function
+    char name[32];
+    initTranslator(cPath);
+    writeCLoopsHeader();
+    for (int i = 0; i < count; i++) {
+        sprintf(name, "loop%d", positions[i]);
+        writeCLoopHeader(name);
+        for (int j = positions[i]; j <= jumps[positions[i]]; j++) {
+            doTranslate(processed[j], j);
+        }
+        writeCLoopFooter();
+    }
+    closeTranslator();
+
+    // build command string
+    char command[strlen("gcc -O1 -shared -fPIC \"%s\" -o \"%s\"") + strlen(cPath) + strlen(soPath)];
+    sprintf(command, "gcc -O1 -shared -fPIC \"%s\" -o \"%s\"", cPath, soPath);
+
+    // compile the loops
+    int commandOut = executeCommand(command);
+    remove(cPath);
+    if (!commandOut) {
+        return 0;
+    }
+
+    // load the loops, the shared object is not needed once loaded
+    void* library = dlopen(soPath, RTLD_NOW | RTLD_LOCAL);
+    remove(soPath);
+    if (library == NULL) {
+        return 0;
+    }
+    nativeLibraries[nativeLibraryCount++] = library;
+
+    // switch to the native loops on their next entry
+    int loaded = 1;
+    for (int i = 0; i < count; i++) {
+        sprintf(name, "loop%d", positions[i]);
+        NativeLoop loop = (NativeLoop) dlsym(library, name);
+        if (loop == NULL) {
+            loaded = 0;
+            continue;
+        }
+        __atomic_store_n(&nativeLoops[positions[i]], loop, __ATOMIC_RELEASE);
+    }
+
+    return loaded;
+}
+
+/**
+ * Thread entry point to compile hot loops in the background.
+ * All loops waiting are compiled together by a single compiler invocation.
+ */
+void* compileHotLoops(void* arg) {
+    (void) arg;
+    int positions[MAX_HOT_LOOPS];
+    int failed = 0;     // a failure was reported
+
+    pthread_mutex_lock(&compilerMutex);
+    while (1) {
+        // wait for hot loops
+        while (hotLoopCount == 0 && !compilerStopping) {
+            pthread_cond_wait(&compilerCondition, &compilerMutex);
+        }
+        if (compilerStopping) {
+            break;
+        }
+        // skip loops enclosed by another waiting loop as it runs them natively too
+        int count = 0;
+        for (int i = 0; i < hotLoopCount; i++) {
+            int enclosed = 0;
+            for (int j = 0; j < hotLoopCount; j++) {
+                if (hotLoops[j] < hotLoops[i] && jumps[hotLoops[j]] > hotLoops[i]) {
+                    enclosed = 1;
+                    break;
+                }
+            }
+            if (!enclosed) {
+                positions[count++] = hotLoops[i];
+            }
+        }
+        hotLoopCount = 0;
+        pthread_mutex_unlock(&compilerMutex);
+
+        // loops which failed to compile are not queued again, and stay interpreted
+        if (!compileLoops(positions, count) && !failed) {
+            fprintf(stderr, "Failed to compile hot loops. They will be interpreted.\n");
+            failed = 1;
+        }
+
+        pthread_mutex_lock(&compilerMutex);
+    }
+    pthread_mutex_unlock(&compilerMutex);
+    return NULL;
+}
+
+/**
+ * Initialize tiered execution.
+ * Returns 0 if hot loops cannot be compiled, in which case they are interpreted.
+ */
+int initTiers() {
+    // test if gcc is installed
+    if (!executeCommand("gcc --version")) {
+        fprintf(stderr, "The C compiler \"gcc\" was not found. Hot loops will be interpreted.\n");
+        return 0;
+    }
+
+    // create the directory for generated files
+    if (mkdtemp(nativeDirectory) == NULL) {
+        fprintf(stderr, "Failed to create temporary directory. Hot loops will be interpreted.\n");
+        return 0;
+    }
+    nativeDirectoryCreated = 1;
+
+    nativeLoops = (NativeLoop*) calloc(processedFileSize, sizeof(NativeLoop));
+    loopCounts = (int*) calloc(processedFileSize, sizeof(int));
+    nativeLibraries = (void**) malloc(sizeof(void*) * (processedFileSize));
+
+    // start the background compiler
+    if (pthread_create(&compilerThread, NULL, compileHotLoops, NULL) != 0) {
+        fprintf(stderr, "Failed to create compiler thread. Hot loops will be interpreted.\n");
+        return 0;
+    }
+    compilerRunning = 1;
+
+    return 1;
+}
+
+/**
+ * Queue a hot loop to be compiled in the background.
+ * Returns 0 if too many loops are already waiting.
+ */
+int requestNativeLoop(int position) {
+    int queued = 0;
+    pthread_mutex_lock(&compilerMutex);
+    if (hotLoopCount < MAX_HOT_LOOPS) {
+        hotLoops[hotLoopCount++] = position;
+        pthread_cond_signal(&compilerCondition);
+        queued = 1;
+    }
+    pthread_mutex_unlock(&compilerMutex);
+    return queued;
+}
+
+/**
+ * Clean up tiered execution.
+ * Waits for a loop being compiled, but not for the ones waiting.
+ */
+static inline void cleanupTiers() {
+    // stop the background compiler
+    if (compilerRunning) {
+        pthread_mutex_lock(&compilerMutex);
+        compilerStopping = 1;
+        pthread_cond_signal(&compilerCondition);
+        pthread_mutex_unlock(&compilerMutex);
+        pthread_join(compilerThread, NULL);
+        compilerRunning = 0;
+    }
+
+    // unload shared objects
+    if (nativeLibraries != NULL) {
+        for (int i = 0; i < nativeLibraryCount; i++) {
+            dlclose(nativeLibraries[i]);
+        }
+        free(nativeLibraries);
+        nativeLibraries = NULL;
+    }
+
+    // remove the directory for generated files
+    if (nativeDirectoryCreated) {
+        rmdir(nativeDirectory);
+        nativeDirectoryCreated = 0;
+    }
+
+    // free nativeLoops
+    if (nativeLoops != NULL) {
+        free(nativeLoops);
+        nativeLoops = NULL;
+    }
+
+    // free loopCounts
+    if (loopCounts != NULL) {
+        free(loopCounts);
+        loopCounts = NULL;
+    }
+}
+
+/**
+ * Count an entry into a loop, and queue it to be compiled once hot.
+ * A loop is queued at most once, and no longer counted once queued.
+ */
+static inline void countLoop(int position) {
+    // the loop is queued, compiled, or failed to compile already
+    if (loopCounts[position] == HOT_LOOP_THRESHOLD) {
+        return;
+    }
+
+    // count again from zero if the loop could not be queued
+    if (++loopCounts[position] == HOT_LOOP_THRESHOLD) {
+        if (!requestNativeLoop(position)) {
+            loopCounts[position] = 0;
+        }
+    }
+}
+
+/**
+ * Perform the operation represented by the character.
+ * Loops entered or iterated often enough are compiled in the background,
+ * and run natively once compiled.
+ * Every iteration starts in the same state as an entry, so a long running
+ * loop switches to its native version on its next iteration.
+ */
+static inline void doTieredOperation(char ch) {
+    // handle loop opening ([)
+    if (ch == '[') {
+        int position = filePointer - 1;
+        if (memory[pointer] == 0) {
+            filePointer = jumps[position] + 1;
+            return;
+        }
+
+        // run the native loop if it is compiled
+        NativeLoop loop = __atomic_load_n(&nativeLoops[position], __ATOMIC_ACQUIRE);
+        if (loop != NULL) {
+            loop(memory, &pointer);
+            filePointer = jumps[position] + 1;
+        }
+        else {
+            countLoop(position);
+        }
+    }
+
+    // handle loop closing (])
+    else if (ch == ']') {
+        if (memory[pointer] == 0) {
+            return;
+        }
+
+        // run the rest of the loop natively if it is compiled
+        int position = jumps[filePointer - 1];
+        NativeLoop loop = __atomic_load_n(&nativeLoops[position], __ATOMIC_ACQUIRE);
+        if (loop != NULL) {
+            loop(memory, &pointer);
+        }
+        else {
+            countLoop(position);
+            filePointer = position + 1;
+        }
+    }
+
+    else {
+        doOperation(ch);
+    }
+}
+
+#else
+
+/**
+ * Initialize tiered execution.
+ * Hot loops are compiled into shared objects, which are only loaded on POSIX systems.
+ */
+int initTiers() {
+    fprintf(stderr, "Tiered execution is not supported on this system. Hot loops will be interpreted.\n");
+    return 0;
+}
+
+/**
+ * Clean up tiered execution.
+ */
+static inline void cleanupTiers() {
+}
+
+/**
+ * Perform the operation represented by the character.
+ */
+static inline void doTieredOperation(char ch) {
+    doOperation(ch);
+}
+
+#endif
+
+#endif // BFJIT_H
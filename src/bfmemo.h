@@ -0,0 +1,370 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFMEMO_H
+#define BFMEMO_H
+
+#include "commons.h"
+#include "bfi.h"
+
+/**
+ * A loop whose result only depends on a window of cells around the pointer.
+ * It has no input or output, and no net movement.
+ */
+typedef struct MemoLoop {
+    int low;        // offset of the window from the pointer at the [ of the loop
+    int size;       // size of the window, 0 if the loop is not memoized
+    int hits;
+    int misses;
+    long long work;     // operations run by the recorded misses
+} MemoLoop;
+
+/**
+ * A cached result of a loop.
+ * Entries are kept in a hash table, and in a list from the most to the least
+ * recently used.
+ */
+typedef struct MemoEntry {
+    int position;   // [ of the loop
+    unsigned int hash;
+    int next;       // next entry of the same bucket, or -1
+    int newer;      // more recently used entry, or -1
+    int older;      // less recently used entry, or -1
+    unsigned char input[MAX_MEMO_WINDOW];
+    unsigned char output[MAX_MEMO_WINDOW];
+} MemoEntry;
+
+/**
+ * A loop being run whose result is to be cached once it ends.
+ */
+typedef struct MemoRecord {
+    int position;   // [ of the loop
+    int base;       // position of the window in memory
+    int size;       // size of the window
+    long long start;    // operations run before the loop
+    unsigned int hash;
+    unsigned char input[MAX_MEMO_WINDOW];
+} MemoRecord;
+
+// memoized loops indexed by position of their [ in pre-processed source
+MemoLoop* memoLoops = NULL;
+
+// cache of loop results
+MemoEntry* memoEntries = NULL;
+int* memoBuckets = NULL;
+int memoEntryCount = 0;
+int memoNewest = -1;
+int memoOldest = -1;
+
+// loops being run whose results are to be cached, innermost last
+MemoRecord* memoRecords = NULL;
+int memoRecordCount = 0;
+
+// operations run while memoizing
+long long memoOperations = 0;
+
+// counters of the cache
+long long memoHits = 0;
+long long memoMisses = 0;
+long long memoEvictions = 0;
+
+/**
+ * Widen a window of offsets to include an offset.
+ * Returns 0 if the window grows beyond MAX_MEMO_WINDOW cells.
+ */
+static inline int widenMemoWindow(int offset, int* low, int* high) {
+    if (offset < *low) *low = offset;
+    if (offset > *high) *high = offset;
+    return *high - *low < MAX_MEMO_WINDOW;
+}
+
+/**
+ * Find the net pointer movement of the operations from start to end, and the
+ * window of offsets they use, relative to the pointer at the start of the loop.
+ * Returns LOOP_UNBALANCED if the movement is not fixed, nested loops have net
+ * movement, the window is too large, or there is input or output.
+ */
+int findMemoWindow(int start, int end, int offset, int* low, int* high) {
+    for (int i = start; i < end; i++) {
+        char ch = processed[i];
+
+        if (ch == ADDRESS) {
+            offset += jumps[i];
+            if (!widenMemoWindow(offset, low, high)) return LOOP_UNBALANCED;
+        }
+        else if (ch == DATA || ch == SET_ZERO || ch == SET_VALUE) {
+            continue;
+        }
+        else if (ch == MULTIPLY_ADD) {
+            if (!widenMemoWindow(offset + jumps[i], low, high)) return LOOP_UNBALANCED;
+        }
+        else if (ch == UPDATE_RUN) {
+            if (!widenMemoWindow(offset + operands[i] - 1, low, high)) return LOOP_UNBALANCED;
+        }
+        else if (ch == AFFINE_LOOP) {
+            int offsets[MAX_LOOP_CELLS];
+            readAffineOffsets(constants + jumps[i], operands[i], offsets);
+            for (int j = 0; j < operands[i]; j++) {
+                if (!widenMemoWindow(offset + offsets[j], low, high)) return LOOP_UNBALANCED;
+            }
+        }
+        else if (ch == '[' || ch == IF_OPEN) {
+            if (findMemoWindow(i + 1, jumps[i], offset, low, high) != offset) return LOOP_UNBALANCED;
+            i = jumps[i];
+        }
+        else {
+            // input, output, and scans
+            return LOOP_UNBALANCED;
+        }
+    }
+    return offset;
+}
+
+/**
+ * Initialize memoization of loops.
+ * Loops large enough to be worth it, with no input or output, no net movement,
+ * and using a window of at most MAX_MEMO_WINDOW cells are memoized.
+ */
+void initMemo() {
+    memoLoops = (MemoLoop*) calloc(processedFileSize + 1, sizeof(MemoLoop));
+    for (int i = 0; i < processedFileSize; i++) {
+        if (processed[i] == '[' && jumps[i] - i + 1 >= MIN_MEMO_LOOP_SIZE) {
+            int low = 0, high = 0;
+            if (findMemoWindow(i + 1, jumps[i], 0, &low, &high) == 0) {
+                memoLoops[i].low = low;
+                memoLoops[i].size = high - low + 1;
+            }
+        }
+    }
+
+    memoEntries = (MemoEntry*) malloc(sizeof(MemoEntry) * (MEMO_CACHE_SIZE));
+    memoBuckets = (int*) malloc(sizeof(int) * (MEMO_CACHE_SIZE));
+    for (int i = 0; i < MEMO_CACHE_SIZE; i++) {
+        memoBuckets[i] = -1;
+    }
+    memoRecords = (MemoRecord*) malloc(sizeof(MemoRecord) * (STACK_SIZE));
+}
+
+/**
+ * Find the position in memory of a cell of a window, wrapping around the memory.
+ */
+static inline int memoCell(int base, int i) {
+    return i < MEMORY_SIZE - base ? base + i : i - (MEMORY_SIZE - base);
+}
+
+/**
+ * Hash the input of a loop.
+ */
+static inline unsigned int hashMemoInput(int position, const unsigned char* input, int size) {
+    unsigned int hash = (2166136261u ^ (unsigned int) position) * 16777619u;
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ input[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Remove an entry from the list of recently used entries.
+ */
+static inline void unlinkMemoEntry(int entry) {
+    MemoEntry* e = &memoEntries[entry];
+    if (e->newer != -1) memoEntries[e->newer].older = e->older;
+    else memoNewest = e->older;
+    if (e->older != -1) memoEntries[e->older].newer = e->newer;
+    else memoOldest = e->newer;
+}
+
+/**
+ * Add an entry to the list of recently used entries as the most recent.
+ */
+static inline void pushMemoEntry(int entry) {
+    MemoEntry* e = &memoEntries[entry];
+    e->newer = -1;
+    e->older = memoNewest;
+    if (memoNewest != -1) memoEntries[memoNewest].newer = entry;
+    else memoOldest = entry;
+    memoNewest = entry;
+}
+
+/**
+ * Find the cached result of a loop for its input, or return -1.
+ */
+static inline int findMemoEntry(int position, unsigned int hash, const unsigned char* input, int size) {
+    for (int entry = memoBuckets[hash & (MEMO_CACHE_SIZE - 1)]; entry != -1; entry = memoEntries[entry].next) {
+        MemoEntry* e = &memoEntries[entry];
+        if (e->hash == hash && e->position == position && memcmp(e->input, input, size) == 0) {
+            return entry;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Cache the result of a loop, evicting the least recently used result if full.
+ */
+void storeMemoEntry(MemoRecord* record) {
+    int entry;
+    if (memoEntryCount < MEMO_CACHE_SIZE) {
+        entry = memoEntryCount++;
+    }
+    else {
+        // remove the least recently used entry from its bucket
+        entry = memoOldest;
+        int* link = &memoBuckets[memoEntries[entry].hash & (MEMO_CACHE_SIZE - 1)];
+        while (*link != entry) link = &memoEntries[*link].next;
+        *link = memoEntries[entry].next;
+        unlinkMemoEntry(entry);
+        memoEvictions++;
+    }
+
+    MemoEntry* e = &memoEntries[entry];
+    e->position = record->position;
+    e->hash = record->hash;
+    memcpy(e->input, record->input, record->size);
+    for (int i = 0; i < record->size; i++) {
+        e->output[i] = memory[memoCell(record->base, i)];
+    }
+
+    int* bucket = &memoBuckets[record->hash & (MEMO_CACHE_SIZE - 1)];
+    e->next = *bucket;
+    *bucket = entry;
+    pushMemoEntry(entry);
+}
+
+/**
+ * Enter a memoized loop.
+ * Replays its cached result if its input was seen before, and otherwise
+ * runs it, recording its result once it ends.
+ * Loops which rarely hit the cache stop being memoized.
+ */
+void enterMemoLoop(int position) {
+    MemoLoop* loop = &memoLoops[position];
+    int base = pointer + loop->low;
+    if (base < 0) base += MEMORY_SIZE;
+
+    unsigned char input[MAX_MEMO_WINDOW];
+    for (int i = 0; i < loop->size; i++) {
+        input[i] = memory[memoCell(base, i)];
+    }
+    unsigned int hash = hashMemoInput(position, input, loop->size);
+
+    // replay the cached result and skip the loop
+    int entry = findMemoEntry(position, hash, input, loop->size);
+    if (entry != -1) {
+        for (int i = 0; i < loop->size; i++) {
+            memory[memoCell(base, i)] = memoEntries[entry].output[i];
+        }
+        unlinkMemoEntry(entry);
+        pushMemoEntry(entry);
+        filePointer = jumps[position] + 1;
+        loop->hits++;
+        memoHits++;
+        return;
+    }
+    loop->misses++;
+    memoMisses++;
+
+    // give up on loops which rarely hit, or run for less than a lookup costs
+    if (loop->misses >= MEMO_PROBATION
+            && (loop->misses > MEMO_MISS_RATIO * loop->hits || loop->work < MIN_MEMO_WORK * loop->misses)) {
+        loop->size = 0;
+        return;
+    }
+
+    // record the result once the loop ends
+    if (memoRecordCount < STACK_SIZE) {
+        MemoRecord* record = &memoRecords[memoRecordCount++];
+        record->position = position;
+        record->base = base;
+        record->size = loop->size;
+        record->start = memoOperations;
+        record->hash = hash;
+        memcpy(record->input, input, loop->size);
+    }
+}
+
+/**
+ * Perform the operation represented by the character.
+ * Memoized loops replay cached results instead of running when possible.
+ */
+static inline void doMemoizedOperation(char ch) {
+    memoOperations++;
+
+    // handle loop opening ([) of a memoized loop
+    if (ch == '[' && memoLoops[filePointer - 1].size > 0 && memory[pointer] != 0) {
+        enterMemoLoop(filePointer - 1);
+    }
+
+    // handle loop ending (]) of a loop whose result is recorded
+    else if (ch == ']' && memory[pointer] == 0 && memoRecordCount > 0
+            && memoRecords[memoRecordCount - 1].position == jumps[filePointer - 1]) {
+        MemoRecord* record = &memoRecords[--memoRecordCount];
+        memoLoops[record->position].work += memoOperations - record->start;
+        storeMemoEntry(record);
+    }
+
+    else {
+        doOperation(ch);
+    }
+}
+
+/**
+ * Report the counters of the cache of loop results.
+ */
+void reportMemo() {
+    int loops = 0, memoized = 0;
+    for (int i = 0; i < processedFileSize; i++) {
+        if (memoLoops[i].size > 0 || memoLoops[i].misses > 0) loops++;
+        if (memoLoops[i].size > 0) memoized++;
+    }
+    long long lookups = memoHits + memoMisses;
+    fprintf(stderr, "Memoized %d loops, %d still memoized: %lld hits, %lld misses (%.1f%% hit rate), %lld evictions\n",
+        loops, memoized, memoHits, memoMisses, lookups > 0 ? 100.0 * memoHits / lookups : 0.0, memoEvictions);
+}
+
+/**
+ * Clean up memoization of loops.
+ */
+static inline void cleanupMemo() {
+    // free memoLoops
+    if (memoLoops != NULL) {
+        free(memoLoops);
+        memoLoops = NULL;
+    }
+
+    // free memoEntries
+    if (memoEntries != NULL) {
+        free(memoEntries);
+        memoEntries = NULL;
+    }
+
+    // free memoBuckets
+    if (memoBuckets != NULL) {
+        free(memoBuckets);
+        memoBuckets = NULL;
+    }
+
+    // free memoRecords
+    if (memoRecords != NULL) {
+        free(memoRecords);
+        memoRecords = NULL;
+    }
+}
+
+#endif // BFMEMO_H
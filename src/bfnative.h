@@ -0,0 +1,356 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFNATIVE_H
+#define BFNATIVE_H
+
+#include "commons.h"
+#include "bftoc.h"
+
+#ifdef POSIX_SYSTEM
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Buffers and functions a native program reads and writes through.
+ * Written identically by the translator into the native program.
+ */
+typedef struct NativeIO {
+    unsigned char* output;
+    int outputSize;         // 1 to write every character at once
+    unsigned char* input;
+    int inputSize;
+    void (*write)(const unsigned char* data, int length);
+    int (*read)(unsigned char* data, int size);
+} NativeIO;
+
+typedef void (*NativeProgram)(unsigned char* tape, int* position, const NativeIO* io);
+
+// entry point of the loaded native program
+NativeProgram nativeProgram = NULL;
+
+// handle of the shared object of the native program
+void* nativeProgramLibrary = NULL;
+
+// translated C code of each translation unit
+char* nativeSources[MAX_C_UNIT_COUNT];
+size_t nativeSourceSizes[MAX_C_UNIT_COUNT];
+
+/**
+ * Create a directory if it does not exist.
+ * Returns 0 if it could not be created.
+ */
+static int makeDirectory(const char* path, mode_t mode) {
+    return mkdir(path, mode) == 0 || errno == EEXIST;
+}
+
+/**
+ * Check if a file is owned by the user and cannot be written by anyone else.
+ * Only such files are trusted to be loaded into the process.
+ */
+static int isPrivate(const struct stat* status) {
+    return status->st_uid == getuid() && (status->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/**
+ * Find the directory caching shared objects of native programs, creating it if needed.
+ * It is in $XDG_CACHE_HOME, or else in ~/.cache, and must be private to the user.
+ * Returns 0 if there is no such directory, leaving directory empty if neither is set.
+ */
+int findNativeCache(char* directory, size_t size) {
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cache != NULL && cache[0] != '\0') {
+        snprintf(directory, size, "%s", cache);
+    }
+    else if (home != NULL && home[0] != '\0') {
+        snprintf(directory, size, "%s/.cache", home);
+    }
+    else {
+        directory[0] = '\0';
+        return 0;
+    }
+    if (!makeDirectory(directory, 0700)) {
+        return 0;
+    }
+
+    size_t length = strlen(directory);
+    snprintf(directory + length, size - length, "/%s", NATIVE_CACHE_DIRECTORY);
+    struct stat status;
+    return makeDirectory(directory, 0700) && stat(directory, &status) == 0 && S_ISDIR(status.st_mode) && isPrivate(&status);
+}
+
+/**
+ * Translate the program into C code in memory, one buffer per translation unit.
+ */
+void translateNative() {
+    planCFunctions();
+    for (int unit = 0; unit < cUnitCount; unit++) {
+        initTranslatorBuffer(&nativeSources[unit], &nativeSourceSizes[unit]);
+        writeCUnit(unit);
+        closeTranslator();
+    }
+}
+
+/**
+ * Hash the translated C code and the flags it is compiled with (FNV-1a).
+ * Programs with the same hash share a shared object.
+ */
+unsigned long long hashNativeSources() {
+    unsigned long long hash = 14695981039346656037ULL;
+    const char* flags = VERSION " " NATIVE_CFLAGS " " NATIVE_LDFLAGS;
+    for (const char* c = flags; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    }
+    for (int unit = 0; unit < cUnitCount; unit++) {
+        hash = (hash ^ (unsigned char) unit) * 1099511628211ULL;
+        for (size_t i = 0; i < nativeSourceSizes[unit]; i++) {
+            hash = (hash ^ (unsigned char) nativeSources[unit][i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Compile the translated C code into a shared object at a path.
+ * It is built under a name of its own and renamed into place once complete,
+ * so that concurrent builds of the same program do not see partial files.
+ * Returns 0 if the program could not be compiled.
+ */
+int buildNative(const char* directory, const char* soPath) {
+    // C files are named after the process building them
+    char filePath[PATH_MAX + 64];
+    snprintf(filePath, sizeof(filePath), "%s/build-%d.bf", directory, (int) getpid());
+    char tempPath[PATH_MAX + 64];
+    snprintf(tempPath, sizeof(tempPath), "%s.%d", soPath, (int) getpid());
+
+    // write the C files
+    int written = 1;
+    for (int unit = 0; unit < cUnitCount; unit++) {
+        char* cPath = generateCUnitFilePath(filePath, unit);
+        FILE* file = fopen(cPath, "w");
+        if (file == NULL || fwrite(nativeSources[unit], 1, nativeSourceSizes[unit], file) != nativeSourceSizes[unit]) {
+            written = 0;
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(cPath);
+    }
+
+    // compile the C files
+    int commandOut = 0;
+    if (!written) {
+        commandOut = 0;
+    }
+    else if (cUnitCount == 1) {
+        char cPath[PATH_MAX + 64];
+        snprintf(cPath, sizeof(cPath), "%s/build-%d.c", directory, (int) getpid());
+        char command[strlen("gcc " NATIVE_CFLAGS " " NATIVE_LDFLAGS " \"%s\" -o \"%s\"") + sizeof(cPath) + sizeof(tempPath)];
+        snprintf(command, sizeof(command), "gcc " NATIVE_CFLAGS " " NATIVE_LDFLAGS " \"%s\" -o \"%s\"", cPath, tempPath);
+
+        commandOut = executeCommand(command);
+    }
+    else {
+        commandOut = compileUnits(filePath, tempPath, " " NATIVE_CFLAGS, " " NATIVE_LDFLAGS);
+    }
+
+    // remove the C files
+    for (int unit = 0; unit < cUnitCount; unit++) {
+        char* cPath = generateCUnitFilePath(filePath, unit);
+        remove(cPath);
+        free(cPath);
+    }
+
+    // move the shared object into place, writable only by the user
+    if (commandOut && (chmod(tempPath, 0755) != 0 || rename(tempPath, soPath) != 0)) {
+        commandOut = 0;
+    }
+    if (!commandOut) {
+        remove(tempPath);
+    }
+    return commandOut;
+}
+
+/**
+ * Replace the shared object at a path with a freshly compiled one.
+ * Returns 0 if the program could not be compiled.
+ */
+int rebuildNative(const char* directory, const char* soPath) {
+    remove(soPath);
+
+    // test if gcc is installed
+    if (!executeCommand("gcc --version")) {
+        fprintf(stderr, "The C compiler \"gcc\" was not found. The program will be interpreted.\n");
+        return 0;
+    }
+    if (!buildNative(directory, soPath)) {
+        fprintf(stderr, "Failed to compile program. The program will be interpreted.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Translate the program to C, and load it as a shared object.
+ * The shared object is cached by the hash of the C code, and only built
+ * with gcc if the program was not run natively before, or if the cached
+ * one is not private to the user or cannot be loaded.
+ * Returns 0 if it could not be loaded, in which case the program is interpreted.
+ */
+int initNative() {
+    translateNative();
+
+    // find the shared object in the cache
+    char directory[PATH_MAX];
+    if (!findNativeCache(directory, sizeof(directory) - 32)) {
+        if (directory[0] == '\0') {
+            fprintf(stderr, "Neither XDG_CACHE_HOME nor HOME is set. The program will be interpreted.\n");
+        }
+        else {
+            fprintf(stderr, "Failed to create private cache directory: %s. The program will be interpreted.\n", directory);
+        }
+        return 0;
+    }
+    char soPath[PATH_MAX + 32];
+    snprintf(soPath, sizeof(soPath), "%s/%016llx.so", directory, hashNativeSources());
+
+    // build the shared object if it is not cached, or not private to the user
+    struct stat status;
+    int cached = lstat(soPath, &status) == 0 && S_ISREG(status.st_mode) && isPrivate(&status);
+    if (!cached && !rebuildNative(directory, soPath)) {
+        return 0;
+    }
+
+    // load the shared object, rebuilding a cached one which cannot be loaded
+    nativeProgramLibrary = dlopen(soPath, RTLD_NOW | RTLD_LOCAL);
+    if (nativeProgramLibrary == NULL && cached) {
+        if (!rebuildNative(directory, soPath)) {
+            return 0;
+        }
+        nativeProgramLibrary = dlopen(soPath, RTLD_NOW | RTLD_LOCAL);
+    }
+    if (nativeProgramLibrary == NULL) {
+        fprintf(stderr, "Failed to load compiled program: %s. The program will be interpreted.\n", dlerror());
+        return 0;
+    }
+    nativeProgram = (NativeProgram) dlsym(nativeProgramLibrary, "runProgram");
+    if (nativeProgram == NULL) {
+        fprintf(stderr, "Failed to load compiled program: %s. The program will be interpreted.\n", soPath);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Write output of the native program to stdout.
+ */
+static void writeNativeOutput(const unsigned char* data, int length) {
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+    outputOffset += length;
+}
+
+/**
+ * Read input of the native program from stdin.
+ * Returns the number of characters read, or 0 at the end of input.
+ */
+static int readNativeInput(unsigned char* data, int size) {
+    ssize_t count;
+    do {
+        count = read(STDIN_FILENO, data, size);
+    } while (count == -1 && errno == EINTR);
+
+    if (count <= 0) {
+        return 0;
+    }
+    inputOffset += count;
+    return (int) count;
+}
+
+/**
+ * Run the loaded native program on the memory of the interpreter.
+ * Output to a terminal is written at once, otherwise it is buffered.
+ */
+void runNative() {
+    unsigned char output[NATIVE_BUFFER_SIZE];
+    unsigned char input[NATIVE_BUFFER_SIZE];
+
+    NativeIO io;
+    io.output = output;
+    io.outputSize = isatty(STDOUT_FILENO) ? 1 : NATIVE_BUFFER_SIZE;
+    io.input = input;
+    io.inputSize = NATIVE_BUFFER_SIZE;
+    io.write = writeNativeOutput;
+    io.read = readNativeInput;
+
+    nativeProgram(memory, &pointer, &io);
+}
+
+/**
+ * Clean up the native program.
+ */
+static inline void cleanupNative() {
+    // unload the shared object
+    if (nativeProgramLibrary != NULL) {
+        dlclose(nativeProgramLibrary);
+        nativeProgramLibrary = NULL;
+        nativeProgram = NULL;
+    }
+
+    // free the translated C code
+    for (int unit = 0; unit < MAX_C_UNIT_COUNT; unit++) {
+        if (nativeSources[unit] != NULL) {
+            free(nativeSources[unit]);
+            nativeSources[unit] = NULL;
+        }
+    }
+}
+
+#else
+
+/**
+ * Translate the program to C, and load it as a shared object.
+ * Shared objects are only loaded on POSIX systems, so the program is interpreted.
+ */
+int initNative() {
+    fprintf(stderr, "Native execution is not supported on this system. The program will be interpreted.\n");
+    return 0;
+}
+
+/**
+ * Run the loaded native program on the memory of the interpreter.
+ */
+void runNative() {
+}
+
+/**
+ * Clean up the native program.
+ */
+static inline void cleanupNative() {
+}
+
+#endif
+
+#endif // BFNATIVE_H
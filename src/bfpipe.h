@@ -0,0 +1,362 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFPIPE_H
+#define BFPIPE_H
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "commons.h"
+
+#ifdef POSIX_SYSTEM
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+/**
+ * Single producer single consumer ring buffer between two stages.
+ * It lives in memory shared by the stages.
+ * The producer only writes head, and the consumer only writes tail.
+ * A stage only sleeps when the buffer is empty or full, and the other stage
+ * wakes it once a batch is ready or before it sleeps itself.
+ */
+typedef struct Channel {
+    size_t head;            // bytes written, updated by the producer
+    char headPadding[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t tail;            // bytes read, updated by the consumer
+    char tailPadding[CACHE_LINE_SIZE - sizeof(size_t)];
+    int closed;             // set once the producer finishes
+    int abandoned;          // set once the consumer finishes
+    int readerWaiting;      // set while the consumer sleeps
+    int writerWaiting;      // set while the producer sleeps
+    pthread_mutex_t mutex;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    unsigned char buffer[PIPELINE_BUFFER_SIZE];
+} Channel;
+
+/**
+ * One end of a channel, local to the stage using it.
+ */
+typedef struct Endpoint {
+    Channel* channel;       // NULL for stdin and stdout
+    size_t position;        // local copy of head or tail
+    size_t limit;           // position which cannot be passed without waiting
+    size_t unsignaled;      // bytes since the other stage was last woken
+    int interactive;        // stdin or stdout is a terminal
+} Endpoint;
+
+// input of this stage
+Endpoint pipeIn = { NULL, 0, 0, 0, 0 };
+
+// output of this stage
+Endpoint pipeOut = { NULL, 0, 0, 0, 0 };
+
+// channels shared by all stages
+Channel* channels = NULL;
+int channelCount = 0;
+
+/**
+ * Wake the other stage of a channel if it sleeps.
+ */
+static inline void signalChannel(Endpoint* endpoint, int* waiting, pthread_cond_t* condition) {
+    endpoint->unsignaled = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&endpoint->channel->mutex);
+        pthread_cond_broadcast(condition);
+        pthread_mutex_unlock(&endpoint->channel->mutex);
+    }
+}
+
+/**
+ * Hand all output written so far to the next stage.
+ */
+static inline void flushPipeOutput() {
+    if (pipeOut.channel == NULL) {
+        fflush(stdout);
+    }
+    else if (pipeOut.unsignaled > 0) {
+        signalChannel(&pipeOut, &pipeOut.channel->readerWaiting, &pipeOut.channel->readable);
+    }
+}
+
+/**
+ * Wait until the next stage has read from a full channel.
+ * The stage finishes if the next stage has finished, like a broken pipe.
+ */
+void waitWritable() {
+    Channel* channel = pipeOut.channel;
+
+    // the next stage must run to make space
+    signalChannel(&pipeOut, &channel->readerWaiting, &channel->readable);
+
+    pthread_mutex_lock(&channel->mutex);
+    __atomic_store_n(&channel->writerWaiting, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&channel->tail, __ATOMIC_SEQ_CST) + PIPELINE_BUFFER_SIZE == pipeOut.position
+            && !__atomic_load_n(&channel->abandoned, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&channel->writable, &channel->mutex);
+    }
+    __atomic_store_n(&channel->writerWaiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&channel->mutex);
+
+    if (__atomic_load_n(&channel->abandoned, __ATOMIC_SEQ_CST)) {
+        exit(0);
+    }
+
+    pipeOut.limit = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE) + PIPELINE_BUFFER_SIZE;
+}
+
+/**
+ * Wait until the previous stage has written to an empty channel.
+ * Returns 0 if the previous stage has finished.
+ */
+int waitReadable() {
+    Channel* channel = pipeIn.channel;
+
+    // the previous stage may be waiting for space, and the next one for output
+    signalChannel(&pipeIn, &channel->writerWaiting, &channel->writable);
+    flushPipeOutput();
+
+    pthread_mutex_lock(&channel->mutex);
+    __atomic_store_n(&channel->readerWaiting, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&channel->head, __ATOMIC_SEQ_CST) == pipeIn.position
+            && !__atomic_load_n(&channel->closed, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&channel->readable, &channel->mutex);
+    }
+    __atomic_store_n(&channel->readerWaiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&channel->mutex);
+
+    pipeIn.limit = __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE);
+    return pipeIn.limit != pipeIn.position;
+}
+
+/**
+ * Write a character to the next stage, or to stdout from the last stage.
+ * Output to stdout is flushed at once only if it is a terminal.
+ */
+static inline void pipeOutput(unsigned char value) {
+    Channel* channel = pipeOut.channel;
+
+    // last stage
+    if (channel == NULL) {
+        putchar(value);
+        if (pipeOut.interactive) {
+            fflush(stdout);
+        }
+        return;
+    }
+
+    // wait for space if the channel looked full
+    if (pipeOut.position == pipeOut.limit) {
+        pipeOut.limit = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE) + PIPELINE_BUFFER_SIZE;
+        if (pipeOut.position == pipeOut.limit) {
+            waitWritable();
+        }
+    }
+
+    channel->buffer[pipeOut.position & (PIPELINE_BUFFER_SIZE - 1)] = value;
+    __atomic_store_n(&channel->head, ++pipeOut.position, __ATOMIC_RELEASE);
+
+    // wake the next stage once a batch is ready
+    if (++pipeOut.unsignaled >= PIPELINE_BATCH_SIZE) {
+        signalChannel(&pipeOut, &channel->readerWaiting, &channel->readable);
+    }
+}
+
+/**
+ * Read a character from the previous stage, or from stdin in the first stage.
+ * Returns EOF once the previous stage has finished and its output is read.
+ */
+static inline int pipeInput() {
+    Channel* channel = pipeIn.channel;
+
+    // first stage
+    if (channel == NULL) {
+        // output must not wait behind a user typing
+        if (pipeIn.interactive) {
+            flushPipeOutput();
+        }
+        return getchar();
+    }
+
+    // wait for input if the channel looked empty
+    if (pipeIn.position == pipeIn.limit) {
+        pipeIn.limit = __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE);
+        if (pipeIn.position == pipeIn.limit && !waitReadable()) {
+            return EOF;
+        }
+    }
+
+    unsigned char value = channel->buffer[pipeIn.position & (PIPELINE_BUFFER_SIZE - 1)];
+    __atomic_store_n(&channel->tail, ++pipeIn.position, __ATOMIC_RELEASE);
+
+    // wake the previous stage once a batch of space is free
+    if (++pipeIn.unsignaled >= PIPELINE_BATCH_SIZE) {
+        signalChannel(&pipeIn, &channel->writerWaiting, &channel->writable);
+    }
+
+    return value;
+}
+
+#ifdef POSIX_SYSTEM
+
+/**
+ * Create the channels between stages in memory shared by all stages.
+ */
+void initChannels(int count) {
+    channelCount = count;
+    if (count == 0) {
+        return;
+    }
+
+    channels = (Channel*) mmap(NULL, sizeof(Channel) * count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (channels == MAP_FAILED) {
+        // display error message and exit
+        fprintf(stderr, "Failed to allocate pipeline buffers\n");
+        exit(1);
+    }
+
+    pthread_mutexattr_t mutexAttr;
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_init(&channels[i].mutex, &mutexAttr);
+        pthread_cond_init(&channels[i].readable, &condAttr);
+        pthread_cond_init(&channels[i].writable, &condAttr);
+    }
+
+    pthread_mutexattr_destroy(&mutexAttr);
+    pthread_condattr_destroy(&condAttr);
+}
+
+/**
+ * Run each source file as a stage of a pipeline in its own process.
+ * The output of each stage is the input of the next one.
+ * Exits with failure if any stage fails, stopping the others.
+ */
+void runPipeline(char** paths, int count) {
+    initChannels(count - 1);
+
+    // output buffered so far must not be written by every stage
+    fflush(stdout);
+
+    pid_t stages[count];
+    for (int i = 0; i < count; i++) {
+        stages[i] = fork();
+        if (stages[i] == 0) {
+            // connect this stage to its neighbours
+            pipeIn.channel = i > 0 ? &channels[i - 1] : NULL;
+            pipeIn.interactive = isatty(fileno(stdin));
+            pipeOut.channel = i < count - 1 ? &channels[i] : NULL;
+            pipeOut.interactive = isatty(fileno(stdout));
+            pipeOut.limit = PIPELINE_BUFFER_SIZE;
+
+            execute(paths[i]);
+            exit(0);
+        }
+        else if (stages[i] == -1) {
+            // display error message and exit
+            fprintf(stderr, "Failed to create pipeline stage: %s\n", paths[i]);
+            for (int j = 0; j < i; j++) {
+                kill(stages[j], SIGTERM);
+            }
+            exit(1);
+        }
+    }
+
+    // wait for all stages, stopping the rest once one fails
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid != -1 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0) && !failed) {
+            failed = 1;
+            for (int j = 0; j < count; j++) {
+                if (stages[j] != pid) {
+                    kill(stages[j], SIGTERM);
+                }
+            }
+        }
+    }
+
+    if (failed) {
+        exit(1);
+    }
+}
+
+#else
+
+/**
+ * Run each source file as a stage of a pipeline in its own process.
+ * Stages are forked processes sharing memory, which is only possible on POSIX systems.
+ */
+void runPipeline(char** paths, int count) {
+    (void) paths;
+    (void) count;
+
+    // display error message and exit
+    fprintf(stderr, "Pipelines are not supported on this system\n");
+    exit(1);
+}
+
+#endif
+
+/**
+ * Mark a channel as finished by one of its stages and wake the other.
+ */
+static inline void closeChannel(Channel* channel, int* finished) {
+    __atomic_store_n(finished, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&channel->mutex);
+    pthread_cond_broadcast(&channel->readable);
+    pthread_cond_broadcast(&channel->writable);
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+/**
+ * Clean up the pipeline.
+ * A finishing stage closes its output so that the next stage reads EOF,
+ * and its input so that the previous stage stops writing.
+ */
+static inline void cleanupPipeline() {
+    if (pipeOut.channel != NULL) {
+        closeChannel(pipeOut.channel, &pipeOut.channel->closed);
+        pipeOut.channel = NULL;
+    }
+    if (pipeIn.channel != NULL) {
+        closeChannel(pipeIn.channel, &pipeIn.channel->abandoned);
+        pipeIn.channel = NULL;
+    }
+
+    // unmap the channels
+#ifdef POSIX_SYSTEM
+    if (channels != NULL) {
+        munmap(channels, sizeof(Channel) * channelCount);
+        channels = NULL;
+    }
+#endif
+}
+
+#endif // BFPIPE_H
@@ -0,0 +1,478 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFSESSION_H
+#define BFSESSION_H
+
+#include <errno.h>
+#include <signal.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include "commons.h"
+#include "bfi.h"
+
+#define EXECUTION_DONE      0
+#define EXECUTION_INPUT     1
+#define EXECUTION_OUTPUT    2
+#define EXECUTION_BUDGET    3
+
+#ifdef __linux__
+
+/**
+ * An execution of the pre-processed program which can be suspended and resumed.
+ * Many executions of the same program can run side by side, each with its
+ * own memory and buffered input and output.
+ */
+typedef struct Execution {
+    unsigned char* memory;      // memory of this execution, committed when touched
+    int pointer;
+    int filePointer;            // next operation to be performed
+    int constantOffset;         // characters of the current constant output already written
+    unsigned char input[EXECUTION_BUFFER_SIZE];
+    int inputStart;             // next character to be read
+    int inputEnd;               // character after the last one available
+    int inputClosed;            // no more input will be available
+    unsigned char output[EXECUTION_BUFFER_SIZE];
+    int outputSize;             // characters written and not yet taken by the caller
+} Execution;
+
+/**
+ * Create an execution starting at the first operation.
+ * Returns NULL if its memory cannot be reserved.
+ */
+Execution* createExecution() {
+    Execution* execution = (Execution*) calloc(1, sizeof(Execution));
+    if (execution == NULL) {
+        return NULL;
+    }
+
+    void* reserved = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        free(execution);
+        return NULL;
+    }
+    execution->memory = (unsigned char*) reserved;
+
+    return execution;
+}
+
+/**
+ * Free an execution and its memory.
+ */
+void freeExecution(Execution* execution) {
+    munmap(execution->memory, MEMORY_SIZE);
+    free(execution);
+}
+
+/**
+ * Move unread input to the start of the input buffer to make space.
+ */
+static inline void compactInput(Execution* execution) {
+    int unread = execution->inputEnd - execution->inputStart;
+    memmove(execution->input, execution->input + execution->inputStart, unread);
+    execution->inputStart = 0;
+    execution->inputEnd = unread;
+}
+
+/**
+ * Resume an execution for at most budget operations.
+ * Returns EXECUTION_INPUT when it needs input which is not available,
+ * EXECUTION_OUTPUT when its output buffer is full, EXECUTION_BUDGET when
+ * the budget is spent, or EXECUTION_DONE when the program has ended.
+ * An operation which cannot complete is performed again on the next resume.
+ */
+int resumeExecution(Execution* execution, long long budget) {
+    // the interpreter runs on the globals of the execution being resumed
+    memory = execution->memory;
+    pointer = execution->pointer;
+    filePointer = execution->filePointer;
+
+    int status = EXECUTION_BUDGET;
+    while (budget-- > 0) {
+        if (filePointer == processedFileSize) {
+            status = EXECUTION_DONE;
+            break;
+        }
+        char ch = processed[filePointer++];
+
+        // handle input (,)
+        if (ch == ',') {
+            if (execution->inputStart < execution->inputEnd) {
+                memory[pointer] = execution->input[execution->inputStart++];
+            }
+            else if (execution->inputClosed) {
+                memory[pointer] = (unsigned char) EOF;
+            }
+            else {
+                filePointer--;
+                status = EXECUTION_INPUT;
+                break;
+            }
+        }
+
+        // handle output (.)
+        else if (ch == '.') {
+            if (execution->outputSize == EXECUTION_BUFFER_SIZE) {
+                filePointer--;
+                status = EXECUTION_OUTPUT;
+                break;
+            }
+            execution->output[execution->outputSize++] = memory[pointer];
+        }
+
+        // handle output of constants, which may take several resumes
+        else if (ch == OUTPUT_CONST) {
+            int length = operands[filePointer - 1] - execution->constantOffset;
+            int space = EXECUTION_BUFFER_SIZE - execution->outputSize;
+            if (length > space) {
+                length = space;
+            }
+            memcpy(execution->output + execution->outputSize, constants + jumps[filePointer - 1] + execution->constantOffset, length);
+            execution->outputSize += length;
+            execution->constantOffset += length;
+            if (execution->constantOffset < operands[filePointer - 1]) {
+                filePointer--;
+                status = EXECUTION_OUTPUT;
+                break;
+            }
+            execution->constantOffset = 0;
+        }
+
+        else {
+            doOperation(ch);
+        }
+    }
+
+    execution->pointer = pointer;
+    execution->filePointer = filePointer;
+    memory = NULL;
+
+    return status;
+}
+
+/**
+ * An execution serving a client connection.
+ */
+typedef struct Session {
+    int fd;
+    Execution* execution;
+    int outputStart;            // output already sent to the client
+    int events;                 // events being waited for
+    int done;                   // program has ended
+    int failed;                 // connection has failed
+    int ready;                  // session is in the ready queue
+    struct Session* next;       // next session in the ready queue
+} Session;
+
+// epoll instance of the server
+int serverPoll = -1;
+
+// listening socket of the server, and whether it is out of epoll
+// because no file descriptor was left for a new connection
+int serverListener = -1;
+int listenerPaused = 0;
+
+// sessions to be resumed, in order
+Session* readyHead = NULL;
+Session* readyTail = NULL;
+
+/**
+ * Queue a session to be resumed.
+ */
+static inline void readySession(Session* session) {
+    if (session->ready) {
+        return;
+    }
+    session->ready = 1;
+    session->next = NULL;
+    if (readyTail == NULL) {
+        readyHead = session;
+    }
+    else {
+        readyTail->next = session;
+    }
+    readyTail = session;
+}
+
+/**
+ * Wait for events on the connection of a session.
+ */
+static inline void waitSession(Session* session, int events) {
+    if (session->events != events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = session;
+        epoll_ctl(serverPoll, EPOLL_CTL_MOD, session->fd, &event);
+        session->events = events;
+    }
+}
+
+/**
+ * Close the connection of a session and free it.
+ */
+void closeSession(Session* session) {
+    close(session->fd);
+    freeExecution(session->execution);
+    free(session);
+
+    // accept connections again now that a file descriptor is free
+    if (listenerPaused) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(serverPoll, EPOLL_CTL_ADD, serverListener, &event);
+        listenerPaused = 0;
+    }
+}
+
+/**
+ * Send buffered output of a session to its client.
+ * Returns 1 once all output is sent.
+ */
+int flushSession(Session* session) {
+    Execution* execution = session->execution;
+    while (session->outputStart < execution->outputSize) {
+        ssize_t sent = write(session->fd, execution->output + session->outputStart, execution->outputSize - session->outputStart);
+        if (sent > 0) {
+            session->outputStart += sent;
+        }
+        else {
+            if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                session->failed = 1;
+            }
+            if (errno != EINTR) {
+                return 0;
+            }
+        }
+    }
+    execution->outputSize = 0;
+    session->outputStart = 0;
+    return 1;
+}
+
+/**
+ * Receive input of a session from its client.
+ */
+void receiveSession(Session* session) {
+    Execution* execution = session->execution;
+    compactInput(execution);
+    if (execution->inputEnd == EXECUTION_BUFFER_SIZE) {
+        return;
+    }
+
+    ssize_t received = read(session->fd, execution->input + execution->inputEnd, EXECUTION_BUFFER_SIZE - execution->inputEnd);
+    if (received > 0) {
+        execution->inputEnd += received;
+    }
+    else if (received == 0) {
+        execution->inputClosed = 1;
+    }
+    else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        session->failed = 1;
+    }
+}
+
+/**
+ * Resume a session until it has to wait for its client or yield to others.
+ * Output is sent before waiting for input, so prompts reach the client.
+ */
+void runSession(Session* session) {
+    if (session->failed) {
+        closeSession(session);
+        return;
+    }
+
+    // send output left over from the last run
+    if (!flushSession(session)) {
+        waitSession(session, EPOLLOUT);
+        return;
+    }
+    if (session->done) {
+        closeSession(session);
+        return;
+    }
+
+    int status = resumeExecution(session->execution, SESSION_STEP_BUDGET);
+    int flushed = flushSession(session);
+    if (session->failed) {
+        closeSession(session);
+    }
+    else if (!flushed) {
+        session->done = status == EXECUTION_DONE;
+        waitSession(session, EPOLLOUT);
+    }
+    else if (status == EXECUTION_DONE) {
+        closeSession(session);
+    }
+    else if (status == EXECUTION_INPUT) {
+        waitSession(session, EPOLLIN);
+    }
+    else {
+        readySession(session);
+    }
+}
+
+/**
+ * Accept all waiting connections, each starting a session of the program.
+ * When no file descriptor is left, the listener is taken out of epoll
+ * until a session closes, as it would otherwise stay readable.
+ */
+void acceptSessions(int listener) {
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "Failed to accept connection: %s\n", strerror(errno));
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && epoll_ctl(serverPoll, EPOLL_CTL_DEL, listener, NULL) == 0) {
+                listenerPaused = 1;
+            }
+            return;
+        }
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        Session* session = (Session*) calloc(1, sizeof(Session));
+        Execution* execution = session != NULL ? createExecution() : NULL;
+        if (execution == NULL) {
+            fprintf(stderr, "Failed to create session: out of memory\n");
+            free(session);
+            close(fd);
+            continue;
+        }
+        session->fd = fd;
+        session->execution = execution;
+
+        struct epoll_event event;
+        event.events = 0;
+        event.data.ptr = session;
+        epoll_ctl(serverPoll, EPOLL_CTL_ADD, fd, &event);
+
+        readySession(session);
+    }
+}
+
+/**
+ * Serve the pre-processed program over TCP.
+ * Every connection runs its own execution of the program, reading its
+ * input from and writing its output to the connection.
+ * All sessions are multiplexed by a single thread, and a session waiting
+ * for input only costs the memory it has touched.
+ */
+void runServer(int port) {
+    // a client leaving must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (listener == -1 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        // display error message and exit
+        fprintf(stderr, "Failed to listen on port %d: %s\n", port, strerror(errno));
+        exit(1);
+    }
+
+    serverListener = listener;
+    serverPoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(serverPoll, EPOLL_CTL_ADD, listener, &event);
+
+    fprintf(stderr, "Serving on port %d\n", port);
+
+    struct epoll_event events[SERVER_EVENT_COUNT];
+    while (1) {
+        // only block when no session is ready to run
+        int count = epoll_wait(serverPoll, events, SERVER_EVENT_COUNT, readyHead != NULL ? 0 : -1);
+        for (int i = 0; i < count; i++) {
+            Session* session = (Session*) events[i].data.ptr;
+
+            // new connections
+            if (session == NULL) {
+                acceptSessions(listener);
+                continue;
+            }
+
+            // sessions are only closed when run, so none is freed while queued
+            if (events[i].events & EPOLLERR) {
+                session->failed = 1;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+                receiveSession(session);
+            }
+            readySession(session);
+        }
+
+        // run the sessions ready now, leaving those they queue for next time
+        Session* tail = readyTail;
+        while (readyHead != NULL) {
+            Session* session = readyHead;
+            readyHead = session->next;
+            if (readyHead == NULL) {
+                readyTail = NULL;
+            }
+            session->ready = 0;
+
+            // the session may be freed when run
+            int last = session == tail;
+            runSession(session);
+
+            if (last) {
+                break;
+            }
+        }
+    }
+}
+
+#else
+
+/**
+ * Serving is only supported with epoll.
+ */
+void runServer(int port) {
+    (void) port;
+
+    // display error message and exit
+    fprintf(stderr, "Serving is not supported on this system\n");
+    exit(1);
+}
+
+#endif
+
+#endif // BFSESSION_H
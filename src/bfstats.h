@@ -0,0 +1,168 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFSTATS_H
+#define BFSTATS_H
+
+#include "commons.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define STAT_CYCLES             0
+#define STAT_INSTRUCTIONS       1
+#define STAT_BRANCH_MISSES      2
+#define STAT_CACHE_MISSES       3
+#define STAT_COUNT              4
+
+#ifdef __linux__
+// hardware events measured for each statistic
+static const int statEvents[STAT_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+#endif
+
+// file descriptors of the performance counters, or -1 if not available
+int statCounters[STAT_COUNT] = { -1, -1, -1, -1 };
+
+// number of operations dispatched by the interpreter, or -1 if not dispatched by it
+long long dispatchedOperations = 0;
+
+// wall clock time of the execution phase
+double statsStart = 0;
+double statsTime = 0;
+
+/**
+ * Open and start the hardware performance counters.
+ * Counters which are not available are skipped.
+ */
+static inline void startStats() {
+#ifdef __linux__
+    for (int i = 0; i < STAT_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = statEvents[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // measure this thread only
+        statCounters[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (statCounters[i] != -1) {
+            ioctl(statCounters[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(statCounters[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    statsStart = currentTime();
+}
+
+/**
+ * Stop the hardware performance counters.
+ */
+static inline void stopStats() {
+    statsTime = currentTime() - statsStart;
+#ifdef __linux__
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (statCounters[i] != -1) {
+            ioctl(statCounters[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+/**
+ * Read a hardware performance counter.
+ * Returns -1 if it is not available.
+ */
+static inline long long readStat(int stat) {
+    long long value = -1;
+#ifdef __linux__
+    if (statCounters[stat] == -1 || read(statCounters[stat], &value, sizeof(value)) != sizeof(value)) {
+        value = -1;
+    }
+#else
+    (void) stat;
+#endif
+    return value;
+}
+
+/**
+ * Print a statistic, or that it is not available.
+ */
+static inline void printStat(const char* name, long long value) {
+    if (value >= 0) fprintf(stderr, "    %-20s %lld\n", name, value);
+    else fprintf(stderr, "    %-20s not available\n", name);
+}
+
+/**
+ * Print the statistics of the execution phase.
+ */
+static inline void reportStats() {
+    long long cycles = readStat(STAT_CYCLES);
+    long long instructions = readStat(STAT_INSTRUCTIONS);
+
+    fprintf(stderr, "\nExecution statistics:\n");
+    fprintf(stderr, "    %-20s %.3f s\n", "time", statsTime);
+    printStat("operations", dispatchedOperations);
+    printStat("cycles", cycles);
+    printStat("instructions", instructions);
+    if (cycles > 0 && instructions >= 0) {
+        fprintf(stderr, "    %-20s %.2f\n", "instructions/cycle", (double) instructions / cycles);
+    }
+    printStat("branch misses", readStat(STAT_BRANCH_MISSES));
+    printStat("cache misses", readStat(STAT_CACHE_MISSES));
+    // operations of a native program are not dispatched, so they have no rate
+    if (dispatchedOperations >= 0 && cycles > 0) {
+        fprintf(stderr, "    %-20s %.3f\n", "operations/cycle", (double) dispatchedOperations / cycles);
+    }
+    else if (dispatchedOperations >= 0) {
+        fprintf(stderr, "    %-20s %.1f M/s\n", "operations/second", dispatchedOperations / 1e6 / (statsTime > 0 ? statsTime : 1e-9));
+    }
+    if (cycles < 0) {
+        fprintf(stderr, "Hardware performance counters are not available on this system.\n");
+    }
+}
+
+/**
+ * Close the hardware performance counters.
+ */
+static inline void cleanupStats() {
+#ifdef __linux__
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (statCounters[i] != -1) {
+            close(statCounters[i]);
+            statCounters[i] = -1;
+        }
+    }
+#endif
+}
+
+#endif // BFSTATS_H
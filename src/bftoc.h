@@ -30,6 +30,28 @@ char* exeFilePath = NULL;
 char* indent = NULL;
 int indentPointer;
 
+/**
+ * A function of the translated C program.
+ * It is either a block of top-level operations, or an outlined loop.
+ */
+typedef struct CFunction {
+    int start;      // first operation of the function in pre-processed source
+    int end;        // operation after the last of the function
+    int size;       // operations written in the function itself
+    int unit;       // translation unit the function is written to
+} CFunction;
+
+// functions of the C program, top-level blocks first
+CFunction* cFunctions = NULL;
+int cFunctionCount = 0;
+int cBlockCount = 0;
+
+// loops written as functions of their own, indexed by position of their [
+char* outlined = NULL;
+
+// number of C files the program is split into
+int cUnitCount = 1;
+
 /**
  * Initialize the Brainfuck to C translator.
  */
@@ -48,6 +70,40 @@ static inline void initTranslator(char* filePath) {
     indentPointer = 1;
 }
 
+#ifdef POSIX_SYSTEM
+
+/**
+ * Initialize the Brainfuck to C translator to write C code into a buffer.
+ * The buffer and its size are set once the translator is closed.
+ * Only used by tiered and native execution, which need POSIX systems.
+ */
+static inline void initTranslatorBuffer(char** buffer, size_t* size) {
+    cFile = open_memstream(buffer, size);
+
+    if (cFile == NULL) {
+        // display error message and exit
+        fprintf(stderr, "Failed to allocate buffer for translated C code\n");
+        exit(1);
+    }
+
+    indent = (char*) malloc(sizeof(char) * (STACK_SIZE));
+    indent[0] = '\t';
+    indent[1] = '\0';
+    indentPointer = 1;
+}
+
+#endif
+
+/**
+ * Close the C file written by the Brainfuck to C translator.
+ */
+static inline void closeTranslator() {
+    fclose(cFile);
+    cFile = NULL;
+    free(indent);
+    indent = NULL;
+}
+
 /**
  * Clean up the Brainfuck to C translator.
  */
@@ -64,6 +120,18 @@ static inline void cleanupTranslator() {
         indent = NULL;
     }
 
+    // free cFunctions
+    if (cFunctions != NULL) {
+        free(cFunctions);
+        cFunctions = NULL;
+    }
+
+    // free outlined
+    if (outlined != NULL) {
+        free(outlined);
+        outlined = NULL;
+    }
+
     // free cFilePath
     if (cFilePath != NULL) {
         free(cFilePath);
@@ -77,19 +145,121 @@ static inline void cleanupTranslator() {
     }
 }
 
+/**
+ * Write helper functions for C file.
+ */
+static inline void writeCFunctions() {
+    fprintf(cFile, "static int findZeroLeft(int position) {\n\tfor (int i = position; i >= 0; i--) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\tfor (int i = MEMORY_SIZE - 1; i > position; i--) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\treturn -1;\n}\n\n");
+    fprintf(cFile, "static void updateRun(const unsigned char* add, const unsigned char* keep, int length) {\n\tif (length <= MEMORY_SIZE - pointer) {\n\t\tunsigned char* cells = memory + pointer;\n\t\tfor (int i = 0; i < length; i++) {\n\t\t\tcells[i] = (cells[i] & keep[i]) + add[i];\n\t\t}\n\t}\n\telse {\n\t\tfor (int i = 0; i < length; i++) {\n\t\t\tint position = i < MEMORY_SIZE - pointer ? pointer + i : i - (MEMORY_SIZE - pointer);\n\t\t\tmemory[position] = (memory[position] & keep[i]) + add[i];\n\t\t}\n\t}\n}\n\n");
+    fprintf(cFile, "static void setRun(unsigned char value, int length) {\n\tif (length <= MEMORY_SIZE - pointer) {\n\t\tmemset(memory + pointer, value, length);\n\t}\n\telse {\n\t\tmemset(memory + pointer, value, MEMORY_SIZE - pointer);\n\t\tmemset(memory, value, length - (MEMORY_SIZE - pointer));\n\t}\n}\n\n");
+    fprintf(cFile, "static void affineLoop(const int* offsets, int factor, const unsigned char* power, int size) {\n\tint positions[%d];\n\tunsigned char cells[%d], next[%d];\n\tfor (int i = 0; i < size; i++) {\n\t\tpositions[i] = ((long long) pointer + offsets[i] + MEMORY_SIZE) %% MEMORY_SIZE;\n\t\tcells[i] = memory[positions[i]];\n\t}\n\tfor (int count = (cells[0] * factor) & 255; count != 0; count >>= 1, power += size * (size + 1)) {\n\t\tif (count & 1) {\n\t\t\tfor (int i = 0; i < size; i++) {\n\t\t\t\tconst unsigned char* row = power + i * (size + 1);\n\t\t\t\tunsigned char value = row[size];\n\t\t\t\tfor (int j = 0; j < size; j++) {\n\t\t\t\t\tvalue += row[j] * cells[j];\n\t\t\t\t}\n\t\t\t\tnext[i] = value;\n\t\t\t}\n\t\t\tmemcpy(cells, next, size);\n\t\t}\n\t}\n\tfor (int i = 0; i < size; i++) {\n\t\tmemory[positions[i]] = cells[i];\n\t}\n}\n\n", MAX_LOOP_CELLS, MAX_LOOP_CELLS, MAX_LOOP_CELLS);
+    fprintf(cFile, "static int findZeroRight(int position) {\n\tfor (int i = position; i < MEMORY_SIZE; i++) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\tfor (int i = 0; i < position; i++) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\treturn -1;\n}\n\n");
+}
+
+/**
+ * Check if the C program has its own runtime for buffered input and output.
+ */
+static inline int hasCRuntime() {
+    return freestandingFlag || nativeFlag;
+}
+
+/**
+ * Write the declarations of the input and output functions of the runtime.
+ */
+static inline void writeCRuntimeDeclarations() {
+    fprintf(cFile, "void outputChar(unsigned char value);\n");
+    fprintf(cFile, "void outputString(const char* value, int length);\n");
+    fprintf(cFile, "int inputChar(void);\n\n");
+}
+
+/**
+ * Write the runtime of a freestanding C program, which does not use libc.
+ * Input and output are buffered and use raw system calls, and _start runs main.
+ * Output is flushed when the buffer is full, before reading input, and on exit,
+ * or after every write if it is a terminal.
+ * The first translation unit defines the runtime, the others declare it.
+ */
+static inline void writeCFreestandingRuntime(int unit) {
+    fprintf(cFile, "void* memset(void* destination, int value, __SIZE_TYPE__ length);\n");
+    fprintf(cFile, "void* memcpy(void* destination, const void* source, __SIZE_TYPE__ length);\n");
+    writeCRuntimeDeclarations();
+    if (unit != 0) {
+        return;
+    }
+
+    fprintf(cFile, "#define BUFFER_SIZE %d\n\n", FREESTANDING_BUFFER_SIZE);
+    fprintf(cFile, "#if defined(__x86_64__)\n#define SYS_READ 0\n#define SYS_WRITE 1\n#define SYS_IOCTL 16\n#define SYS_EXIT_GROUP 231\n#define ENTRY __attribute__((force_align_arg_pointer))\n\nstatic long systemCall(long number, long a, long b, long c) {\n\tlong result;\n\t__asm__ volatile (\"syscall\" : \"=a\" (result) : \"a\" (number), \"D\" (a), \"S\" (b), \"d\" (c) : \"rcx\", \"r11\", \"memory\");\n\treturn result;\n}\n");
+    fprintf(cFile, "#elif defined(__aarch64__)\n#define SYS_READ 63\n#define SYS_WRITE 64\n#define SYS_IOCTL 29\n#define SYS_EXIT_GROUP 94\n#define ENTRY\n\nstatic long systemCall(long number, long a, long b, long c) {\n\tregister long x8 __asm__(\"x8\") = number;\n\tregister long x0 __asm__(\"x0\") = a;\n\tregister long x1 __asm__(\"x1\") = b;\n\tregister long x2 __asm__(\"x2\") = c;\n\t__asm__ volatile (\"svc 0\" : \"+r\" (x0) : \"r\" (x8), \"r\" (x1), \"r\" (x2) : \"memory\");\n\treturn x0;\n}\n");
+    fprintf(cFile, "#else\n#error \"Freestanding programs are only supported on x86-64 and AArch64 Linux\"\n#endif\n\n");
+    fprintf(cFile, "#define TCGETS 0x5401\n#define EINTR 4\n\n");
+
+    // loops must not be turned into calls of the functions they implement
+    fprintf(cFile, "__attribute__((optimize(\"no-tree-loop-distribute-patterns\")))\nvoid* memset(void* destination, int value, __SIZE_TYPE__ length) {\n\tunsigned char* bytes = destination;\n\tfor (__SIZE_TYPE__ i = 0; i < length; i++) {\n\t\tbytes[i] = value;\n\t}\n\treturn destination;\n}\n\n");
+    fprintf(cFile, "__attribute__((optimize(\"no-tree-loop-distribute-patterns\")))\nvoid* memcpy(void* destination, const void* source, __SIZE_TYPE__ length) {\n\tunsigned char* bytes = destination;\n\tconst unsigned char* from = source;\n\tfor (__SIZE_TYPE__ i = 0; i < length; i++) {\n\t\tbytes[i] = from[i];\n\t}\n\treturn destination;\n}\n\n");
+
+    fprintf(cFile, "static unsigned char outputBuffer[BUFFER_SIZE];\nstatic int outputLength = 0;\nstatic unsigned char inputBuffer[BUFFER_SIZE];\nstatic int inputPosition = 0;\nstatic int inputLength = 0;\nstatic int interactive = 0;\n\n");
+    fprintf(cFile, "static void flushOutput(void) {\n\tint position = 0;\n\twhile (position < outputLength) {\n\t\tlong written = systemCall(SYS_WRITE, 1, (long) (outputBuffer + position), outputLength - position);\n\t\tif (written > 0) {\n\t\t\tposition += written;\n\t\t}\n\t\telse if (written != -EINTR) {\n\t\t\tbreak;\n\t\t}\n\t}\n\toutputLength = 0;\n}\n\n");
+    fprintf(cFile, "void outputChar(unsigned char value) {\n\toutputBuffer[outputLength++] = value;\n\tif (outputLength == BUFFER_SIZE || interactive) {\n\t\tflushOutput();\n\t}\n}\n\n");
+    fprintf(cFile, "void outputString(const char* value, int length) {\n\tfor (int i = 0; i < length; i++) {\n\t\toutputBuffer[outputLength++] = value[i];\n\t\tif (outputLength == BUFFER_SIZE) {\n\t\t\tflushOutput();\n\t\t}\n\t}\n\tif (interactive) {\n\t\tflushOutput();\n\t}\n}\n\n");
+    fprintf(cFile, "int inputChar(void) {\n\tif (inputPosition == inputLength) {\n\t\tflushOutput();\n\t\tlong count;\n\t\tdo {\n\t\t\tcount = systemCall(SYS_READ, 0, (long) inputBuffer, BUFFER_SIZE);\n\t\t} while (count == -EINTR);\n\t\tif (count <= 0) {\n\t\t\treturn -1;\n\t\t}\n\t\tinputPosition = 0;\n\t\tinputLength = count;\n\t}\n\treturn inputBuffer[inputPosition++];\n}\n\n");
+    fprintf(cFile, "int main(void);\n\nENTRY void _start(void) {\n\tunsigned char terminal[64];\n\tinteractive = systemCall(SYS_IOCTL, 1, TCGETS, (long) terminal) == 0;\n\tint status = main();\n\tflushOutput();\n\tsystemCall(SYS_EXIT_GROUP, status, 0, 0);\n\tfor (;;) {}\n}\n\n");
+}
+
+/**
+ * Write the runtime of a native C program, which is loaded as a shared object.
+ * Its entry point runProgram runs the program on the memory of the interpreter,
+ * reading and writing through buffers and functions passed in as a NativeIO.
+ * Output is flushed when the buffer is full, before reading input, and on return.
+ * The first translation unit defines the runtime, the others declare it.
+ */
+static inline void writeCNativeRuntime(int unit) {
+    writeCRuntimeDeclarations();
+    if (unit != 0) {
+        return;
+    }
+
+    fprintf(cFile, "typedef struct NativeIO {\n\tunsigned char* output;\n\tint outputSize;\n\tunsigned char* input;\n\tint inputSize;\n\tvoid (*write)(const unsigned char* data, int length);\n\tint (*read)(unsigned char* data, int size);\n} NativeIO;\n\n");
+    fprintf(cFile, "static const NativeIO* io;\nstatic int outputLength = 0;\nstatic int inputPosition = 0;\nstatic int inputLength = 0;\n\n");
+    fprintf(cFile, "static void flushOutput(void) {\n\tif (outputLength > 0) {\n\t\tio->write(io->output, outputLength);\n\t\toutputLength = 0;\n\t}\n}\n\n");
+    fprintf(cFile, "void outputChar(unsigned char value) {\n\tio->output[outputLength++] = value;\n\tif (outputLength == io->outputSize) {\n\t\tflushOutput();\n\t}\n}\n\n");
+    fprintf(cFile, "void outputString(const char* value, int length) {\n\tfor (int i = 0; i < length; i++) {\n\t\tio->output[outputLength++] = value[i];\n\t\tif (outputLength == io->outputSize) {\n\t\t\tflushOutput();\n\t\t}\n\t}\n}\n\n");
+    fprintf(cFile, "int inputChar(void) {\n\tif (inputPosition == inputLength) {\n\t\tflushOutput();\n\t\tinputPosition = 0;\n\t\tinputLength = io->read(io->input, io->inputSize);\n\t\tif (inputLength <= 0) {\n\t\t\tinputLength = 0;\n\t\t\treturn -1;\n\t\t}\n\t}\n\treturn io->input[inputPosition++];\n}\n\n");
+    fprintf(cFile, "extern unsigned char* memory;\nextern int pointer;\nint runBlocks(void);\n\n");
+    fprintf(cFile, "__attribute__((visibility(\"default\")))\nvoid runProgram(unsigned char* tape, int* position, const NativeIO* nativeIO) {\n\tmemory = tape;\n\tpointer = *position;\n\tio = nativeIO;\n\toutputLength = 0;\n\tinputPosition = 0;\n\tinputLength = 0;\n\trunBlocks();\n\tflushOutput();\n\t*position = pointer;\n}\n\n");
+}
+
 /**
  * Write common header information for C file.
+ * The first translation unit defines memory, the others refer to it.
+ * Freestanding programs use their own runtime instead of libc, and native
+ * programs work on the memory of the interpreter.
  */
-static inline void writeCHeader() {
-    fprintf(cFile, "#include<stdio.h>\n");
-    fprintf(cFile, "#include<string.h>\n\n");
+static inline void writeCHeader(int unit) {
+    if (freestandingFlag) {
+        writeCFreestandingRuntime(unit);
+    }
+    else {
+        fprintf(cFile, "#include<stdio.h>\n");
+        fprintf(cFile, "#include<string.h>\n\n");
+    }
+    if (nativeFlag) {
+        writeCNativeRuntime(unit);
+    }
     fprintf(cFile, "#define MEMORY_SIZE %d\n\n", MEMORY_SIZE);
-    fprintf(cFile, "unsigned char memory[MEMORY_SIZE];\n");
-    fprintf(cFile, "int pointer = 0;\n\n");
-    fprintf(cFile, "int findZeroLeft(int position) {\n\tfor (int i = position; i >= 0; i--) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\tfor (int i = MEMORY_SIZE - 1; i > position; i--) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\treturn -1;\n}\n\n");
-    fprintf(cFile, "int findZeroRight(int position) {\n\tfor (int i = position; i < MEMORY_SIZE; i++) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\tfor (int i = 0; i < position; i++) {\n\t\tif (memory[i] == 0) {\n\t\t\treturn i;\n\t\t}\n\t}\n\treturn -1;\n}\n\n");
-    fprintf(cFile, "int main() {\n");
-    fprintf(cFile, "\tmemset(memory, 0, MEMORY_SIZE);\n\n");
+    if (nativeFlag) {
+        fprintf(cFile, "%sunsigned char* memory;\n", unit == 0 ? "" : "extern ");
+        fprintf(cFile, "%sint pointer;\n\n", unit == 0 ? "" : "extern ");
+    }
+    else if (unit == 0) {
+        // memory is zero initialized and its pages are only committed when touched
+        fprintf(cFile, "unsigned char memory[MEMORY_SIZE];\n");
+        fprintf(cFile, "int pointer = 0;\n\n");
+    }
+    else {
+        fprintf(cFile, "extern unsigned char memory[MEMORY_SIZE];\n");
+        fprintf(cFile, "extern int pointer;\n\n");
+    }
+    writeCFunctions();
 }
 
 /**
@@ -100,42 +270,164 @@ static inline void writeCFooter() {
 }
 
 /**
- * Perform the operation represented by the character.
+ * Write common header information for C file of loops.
+ */
+static inline void writeCLoopsHeader() {
+    fprintf(cFile, "#include<stdio.h>\n");
+    fprintf(cFile, "#include<string.h>\n\n");
+    fprintf(cFile, "#define MEMORY_SIZE %d\n\n", MEMORY_SIZE);
+    fprintf(cFile, "static unsigned char* memory;\n");
+    fprintf(cFile, "static int pointer;\n\n");
+    writeCFunctions();
+}
+
+/**
+ * Write header information for a single loop in C file of loops.
+ * The loop is a function operating on the memory and pointer passed in.
+ */
+static inline void writeCLoopHeader(const char* name) {
+    fprintf(cFile, "void %s(unsigned char* tape, int* position) {\n", name);
+    fprintf(cFile, "\tmemory = tape;\n");
+    fprintf(cFile, "\tpointer = *position;\n\n");
+}
+
+/**
+ * Write footer information for a single loop in C file of loops.
+ */
+static inline void writeCLoopFooter() {
+    fprintf(cFile, "\n\t*position = pointer;\n}\n\n");
+}
+
+/**
+ * Translate the operation represented by the character at index.
  * Ignore character if it is not an operator.
  */
-static inline void doTranslate(char ch) {
+static inline void doTranslate(char ch, int index) {
     // handle pointer movement (> and <)
     if (ch == ADDRESS) {
-        int sum = jumps[filePointer - 1];
+        int sum = jumps[index];
 
-        fprintf(cFile, "%spointer += %d;\n", indent, sum);
-        fprintf(cFile, "%sif (pointer >= MEMORY_SIZE) pointer -= MEMORY_SIZE;\n", indent);
-        fprintf(cFile, "%selse if (pointer < 0) pointer += MEMORY_SIZE;\n", indent);
+        // wrap before moving, so that the pointer cannot overflow with large memory
+        if (sum > 0) {
+            fprintf(cFile, "%sif (pointer >= MEMORY_SIZE - %d) pointer -= MEMORY_SIZE - %d;\n", indent, sum, sum);
+            fprintf(cFile, "%selse pointer += %d;\n", indent, sum);
+        }
+        else {
+            fprintf(cFile, "%sif (pointer < %d) pointer += MEMORY_SIZE - %d;\n", indent, -sum, -sum);
+            fprintf(cFile, "%selse pointer -= %d;\n", indent, -sum);
+        }
     }
 
     // handle value update (+ and -)
     else if (ch == DATA) {
-        int sum = jumps[filePointer - 1];
+        int sum = jumps[index];
         fprintf(cFile, "%smemory[pointer] += %d;\n", indent, sum);
     }
 
     // handle output (.)
     else if (ch == '.') {
-        fprintf(cFile, "%sprintf(\"%%c\", memory[pointer]);\n", indent);
-        fprintf(cFile, "%sfflush(stdout);\n", indent);
+        if (hasCRuntime()) {
+            fprintf(cFile, "%soutputChar(memory[pointer]);\n", indent);
+        }
+        else {
+            fprintf(cFile, "%sprintf(\"%%c\", memory[pointer]);\n", indent);
+            fprintf(cFile, "%sfflush(stdout);\n", indent);
+        }
     }
 
     // handle input (,)
     else if (ch == ',') {
-        fprintf(cFile, "%smemory[pointer] = getchar();\n", indent);
+        fprintf(cFile, "%smemory[pointer] = %s();\n", indent, hasCRuntime() ? "inputChar" : "getchar");
     }
 
     // handle [-]
     else if (ch == SET_ZERO) {
-        memory[pointer] = 0;
         fprintf(cFile, "%smemory[pointer] = 0;\n", indent);
     }
 
+    // handle set(value)
+    else if (ch == SET_VALUE) {
+        fprintf(cFile, "%smemory[pointer] = %d;\n", indent, jumps[index]);
+    }
+
+    // handle output of constants
+    else if (ch == OUTPUT_CONST) {
+        int length = operands[index];
+        unsigned char* value = constants + jumps[index];
+
+        fprintf(cFile, hasCRuntime() ? "%soutputString(\"" : "%sfwrite(\"", indent);
+        for (int i = 0; i < length; i++) {
+            if (isprint(value[i]) && value[i] != '"' && value[i] != '\\' && value[i] != '?') {
+                fputc(value[i], cFile);
+            }
+            else {
+                fprintf(cFile, "\\%03o", value[i]);
+            }
+        }
+        if (hasCRuntime()) {
+            fprintf(cFile, "\", %d);\n", length);
+        }
+        else {
+            fprintf(cFile, "\", 1, %d, stdout);\n", length);
+            fprintf(cFile, "%sfflush(stdout);\n", indent);
+        }
+    }
+
+    // handle update of a run of cells
+    // runs setting every cell to the same value are written as memset
+    else if (ch == UPDATE_RUN) {
+        int length = operands[index];
+        unsigned char* add = constants + jumps[index];
+        unsigned char* keep = add + length;
+
+        int same = 1;
+        for (int i = 0; i < length; i++) {
+            if (keep[i] != 0 || add[i] != add[0]) {
+                same = 0;
+                break;
+            }
+        }
+
+        if (same) {
+            fprintf(cFile, "%ssetRun(%d, %d);\n", indent, add[0], length);
+        }
+        else {
+            fprintf(cFile, "%supdateRun((const unsigned char[]) {", indent);
+            for (int i = 0; i < length; i++) {
+                fprintf(cFile, i > 0 ? ", %d" : "%d", add[i]);
+            }
+            fprintf(cFile, "}, (const unsigned char[]) {");
+            for (int i = 0; i < length; i++) {
+                fprintf(cFile, i > 0 ? ", %d" : "%d", keep[i]);
+            }
+            fprintf(cFile, "}, %d);\n", length);
+        }
+    }
+
+    // handle multiply-add of the current cell into the cell at an offset
+    else if (ch == MULTIPLY_ADD) {
+        int offset = jumps[index] < 0 ? jumps[index] + MEMORY_SIZE : jumps[index];
+        fprintf(cFile, "%smemory[((long long) pointer + %d) %% MEMORY_SIZE] += memory[pointer] * %d;\n", indent, offset, operands[index]);
+    }
+
+    // handle loop whose iteration is an affine map of its cells
+    else if (ch == AFFINE_LOOP) {
+        int size = operands[index];
+        unsigned char* data = constants + jumps[index];
+        int offsets[MAX_LOOP_CELLS];
+        memcpy(offsets, data, sizeof(int) * size);
+
+        fprintf(cFile, "%saffineLoop((const int[]) {", indent);
+        for (int i = 0; i < size; i++) {
+            fprintf(cFile, i > 0 ? ", %d" : "%d", offsets[i]);
+        }
+        fprintf(cFile, "}, %d, (const unsigned char[]) {", data[sizeof(int) * size]);
+        for (int i = 0; i < 8 * size * (size + 1); i++) {
+            fprintf(cFile, i > 0 ? ", %d" : "%d", data[sizeof(int) * size + 1 + i]);
+        }
+        fprintf(cFile, "}, %d);\n", size);
+    }
+
     // handle [<]
     else if (ch == SCAN_ZERO_LEFT) {
         fprintf(cFile, "%spointer = findZeroLeft(pointer);\n", indent);
@@ -147,8 +439,16 @@ static inline void doTranslate(char ch) {
     }
 
     // handle loop opening ([)
+    // loops whose trip count is known on entry are counted, so that gcc can unroll them
     else if (ch == '[') {
-        fprintf(cFile, "%swhile (memory[pointer] != 0) {\n", indent);
+        int step = loopStep(index);
+        if (step != 0) {
+            fprintf(cFile, "%sfor (int count%d = (unsigned char) (memory[pointer] * %d); count%d > 0; count%d--) {\n",
+                indent, index, tripCountFactor(step), index, index);
+        }
+        else {
+            fprintf(cFile, "%swhile (memory[pointer] != 0) {\n", indent);
+        }
         indent[indentPointer++] = '\t';
         indent[indentPointer] = '\0';
     }
@@ -159,6 +459,225 @@ static inline void doTranslate(char ch) {
         indent[--indentPointer] = '\0';
         fprintf(cFile, "%s}\n", indent);
     }
+
+    // handle loop opening which runs at most once
+    else if (ch == IF_OPEN) {
+        fprintf(cFile, "%sif (memory[pointer] != 0) {\n", indent);
+        indent[indentPointer++] = '\t';
+        indent[indentPointer] = '\0';
+    }
+
+    // handle loop closing which runs at most once
+    else if (ch == IF_CLOSE) {
+        indent[--indentPointer] = '\0';
+        fprintf(cFile, "%s}\n", indent);
+    }
+}
+
+/**
+ * Check if the operation opens a loop or a conditional.
+ */
+static inline int isCLoop(char ch) {
+    return ch == '[' || ch == IF_OPEN;
+}
+
+/**
+ * Add an outlined loop to the functions of the C program.
+ */
+static inline void outlineCLoop(int position) {
+    outlined[position] = 1;
+    cFunctions[cFunctionCount].start = position;
+    cFunctions[cFunctionCount].end = jumps[position] + 1;
+    cFunctions[cFunctionCount].size = 0;
+    cFunctionCount++;
+}
+
+/**
+ * Find the size of the body of a function, outlining loops which do not fit.
+ * Loops which fit are written inline in full.
+ */
+int planCFunctionBody(int start, int end, int size) {
+    for (int i = start; i < end; i++) {
+        if (isCLoop(processed[i])) {
+            int loopSize = jumps[i] - i + 1;
+            if (size + loopSize > MAX_C_FUNCTION_SIZE) {
+                outlineCLoop(i);
+                loopSize = 1;
+            }
+            size += loopSize;
+            i = jumps[i];
+        }
+        else {
+            size++;
+        }
+    }
+    return size;
+}
+
+/**
+ * Split the program into functions and translation units.
+ * Top-level operations are split into blocks, and loops too large for the
+ * function they are in are outlined into functions of their own, so that
+ * no function is much larger than MAX_C_FUNCTION_SIZE operations.
+ * Functions are spread over up to MAX_C_UNIT_COUNT C files which can be
+ * compiled in parallel.
+ */
+void planCFunctions() {
+    cFunctions = (CFunction*) malloc(sizeof(CFunction) * (processedFileSize + 1));
+    outlined = (char*) calloc(processedFileSize + 1, sizeof(char));
+    cFunctionCount = 0;
+
+    // split top-level operations into blocks
+    int size = 0;
+    for (int i = 0; i < processedFileSize; i++) {
+        int operationSize = isCLoop(processed[i]) ? jumps[i] - i + 1 : 1;
+
+        // start a new block if the operation does not fit
+        if (cFunctionCount == 0 || (size > 0 && size + operationSize > MAX_C_FUNCTION_SIZE)) {
+            if (cFunctionCount > 0) {
+                cFunctions[cFunctionCount - 1].end = i;
+                cFunctions[cFunctionCount - 1].size = size;
+            }
+            cFunctions[cFunctionCount].start = i;
+            cFunctionCount++;
+            size = 0;
+        }
+
+        // outline loops too large for a block of their own
+        if (operationSize > MAX_C_FUNCTION_SIZE) {
+            outlined[i] = 1;
+            operationSize = 1;
+        }
+        size += operationSize;
+
+        if (isCLoop(processed[i])) {
+            i = jumps[i];
+        }
+    }
+    if (cFunctionCount == 0) {
+        cFunctions[0].start = 0;
+        cFunctionCount = 1;
+    }
+    cFunctions[cFunctionCount - 1].end = processedFileSize;
+    cFunctions[cFunctionCount - 1].size = size;
+    cBlockCount = cFunctionCount;
+
+    // outline top-level loops too large for a block
+    for (int i = 0; i < cBlockCount; i++) {
+        for (int j = cFunctions[i].start; j < cFunctions[i].end; j++) {
+            if (outlined[j]) {
+                outlineCLoop(j);
+            }
+            if (isCLoop(processed[j])) {
+                j = jumps[j];
+            }
+        }
+    }
+
+    // plan outlined loops, which may outline loops within them
+    for (int i = cBlockCount; i < cFunctionCount; i++) {
+        cFunctions[i].size = planCFunctionBody(cFunctions[i].start + 1, cFunctions[i].end - 1, 2);
+    }
+
+    // spread functions over translation units, filling the least full first
+    int total = 0;
+    for (int i = 0; i < cFunctionCount; i++) {
+        total += cFunctions[i].size;
+    }
+    cUnitCount = (total + MAX_C_UNIT_SIZE - 1) / MAX_C_UNIT_SIZE;
+    if (cUnitCount > MAX_C_UNIT_COUNT) cUnitCount = MAX_C_UNIT_COUNT;
+    if (cUnitCount < 1) cUnitCount = 1;
+
+    int unitSizes[cUnitCount];
+    memset(unitSizes, 0, sizeof(unitSizes));
+    for (int i = 0; i < cFunctionCount; i++) {
+        int unit = 0;
+        for (int j = 1; j < cUnitCount; j++) {
+            if (unitSizes[j] < unitSizes[unit]) unit = j;
+        }
+        cFunctions[i].unit = unit;
+        unitSizes[unit] += cFunctions[i].size;
+    }
+}
+
+/**
+ * Write the name of a function of the C program.
+ */
+static inline void writeCFunctionName(int function) {
+    if (function < cBlockCount) {
+        fprintf(cFile, "block%d", function);
+    }
+    else {
+        fprintf(cFile, "loop%d", cFunctions[function].start);
+    }
+}
+
+/**
+ * Write the body of a function of the C program.
+ * Outlined loops within it are written as calls.
+ */
+static inline void writeCFunctionBody(CFunction* function) {
+    indent[0] = '\t';
+    indent[1] = '\0';
+    indentPointer = 1;
+
+    for (int i = function->start; i < function->end; i++) {
+        if (outlined[i] && i != function->start) {
+            fprintf(cFile, "%sloop%d();\n", indent, i);
+            i = jumps[i];
+        }
+        else {
+            doTranslate(processed[i], i);
+        }
+    }
+}
+
+/**
+ * Write a translation unit of the C program.
+ * The first one also holds main, which calls the top-level blocks in order.
+ * A program of a single function is written in main.
+ * Main of a native program is runBlocks, called by its entry point.
+ */
+void writeCUnit(int unit) {
+    writeCHeader(unit);
+
+    // single function
+    if (cFunctionCount == 1) {
+        fprintf(cFile, "int %s() {\n", nativeFlag ? "runBlocks" : "main");
+        writeCFunctionBody(&cFunctions[0]);
+        writeCFooter();
+        return;
+    }
+
+    // declare all functions as any of them may be called
+    for (int i = 0; i < cFunctionCount; i++) {
+        fprintf(cFile, "void ");
+        writeCFunctionName(i);
+        fprintf(cFile, "(void);\n");
+    }
+    fprintf(cFile, "\n");
+
+    // write functions of this unit
+    for (int i = 0; i < cFunctionCount; i++) {
+        if (cFunctions[i].unit == unit) {
+            fprintf(cFile, "void ");
+            writeCFunctionName(i);
+            fprintf(cFile, "(void) {\n");
+            writeCFunctionBody(&cFunctions[i]);
+            fprintf(cFile, "}\n\n");
+        }
+    }
+
+    // write main
+    if (unit == 0) {
+        fprintf(cFile, "int %s() {\n", nativeFlag ? "runBlocks" : "main");
+        for (int i = 0; i < cBlockCount; i++) {
+            fprintf(cFile, "\t");
+            writeCFunctionName(i);
+            fprintf(cFile, "();\n");
+        }
+        writeCFooter();
+    }
 }
 
 #endif // BFTOC_H
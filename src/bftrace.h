@@ -0,0 +1,242 @@
+/**
+ * A fast Brainfuck interpreter, translator, and compiler.
+ * Copyright (C) 2019  Pratanu Mandal
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BFTRACE_H
+#define BFTRACE_H
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "commons.h"
+
+#ifdef POSIX_SYSTEM
+#include <sys/resource.h>
+#endif
+
+/**
+ * Wall clock and CPU time at the start of a traced event.
+ */
+typedef struct TraceMark {
+    double wall;
+    double cpu;             // used by the process itself
+    double childCpu;        // used by the commands it has waited for
+} TraceMark;
+
+/**
+ * A completed event of the trace.
+ */
+typedef struct TraceEvent {
+    char* name;
+    const char* category;   // phase, pass, or command
+    double start;           // wall clock seconds since the trace started
+    double wall;
+    double cpu;             // of the process and its commands, or of the command alone
+    int thread;
+} TraceEvent;
+
+// path to write the trace to, or NULL if not tracing
+char* tracePath = NULL;
+
+// events recorded so far, by any thread
+TraceEvent* traceEvents = NULL;
+int traceEventCount = 0;
+int traceEventCapacity = 0;
+pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// start of the trace, and the process writing it
+TraceMark traceStart;
+pid_t tracePid = 0;
+
+// number of the calling thread in the trace, or 0 if not numbered yet
+static __thread int traceThread = 0;
+int traceThreadCount = 0;
+
+/**
+ * Get the current wall clock time, and the CPU time used by the process
+ * and by the commands it has waited for.
+ * The CPU time of commands is only known on POSIX systems, and 0 elsewhere.
+ */
+static inline TraceMark currentTraceTime() {
+    TraceMark mark;
+    mark.wall = currentTime();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    mark.cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+
+#ifdef POSIX_SYSTEM
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    mark.childCpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+            + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#else
+    mark.childCpu = 0;
+#endif
+
+    return mark;
+}
+
+/**
+ * Start tracing, taking the current time as the start of the trace.
+ */
+void initTrace() {
+    traceStart = currentTraceTime();
+    tracePid = getpid();
+    traceThread = ++traceThreadCount;
+}
+
+/**
+ * Mark the start of an event.
+ */
+static inline TraceMark beginTrace() {
+    TraceMark mark = { 0, 0, 0 };
+    if (tracePath != NULL) {
+        mark = currentTraceTime();
+    }
+    return mark;
+}
+
+/**
+ * Record an event which started at a mark and ends now.
+ * Events may be recorded by any thread.
+ * Commands only count the CPU time of commands, as the process runs on meanwhile.
+ */
+void endTrace(TraceMark* mark, const char* name, const char* category) {
+    if (tracePath == NULL) {
+        return;
+    }
+
+    TraceMark end = currentTraceTime();
+    double cpu = end.childCpu - mark->childCpu;
+    if (strcmp(category, "command") != 0) {
+        cpu += end.cpu - mark->cpu;
+    }
+
+    pthread_mutex_lock(&traceMutex);
+    if (traceThread == 0) {
+        traceThread = ++traceThreadCount;
+    }
+    if (traceEventCount == traceEventCapacity) {
+        traceEventCapacity = traceEventCapacity > 0 ? 2 * traceEventCapacity : 64;
+        traceEvents = (TraceEvent*) realloc(traceEvents, sizeof(TraceEvent) * traceEventCapacity);
+    }
+    TraceEvent* event = &traceEvents[traceEventCount++];
+    event->name = strdup(name);
+    event->category = category;
+    event->start = mark->wall - traceStart.wall;
+    event->wall = end.wall - mark->wall;
+    event->cpu = cpu;
+    event->thread = traceThread;
+    pthread_mutex_unlock(&traceMutex);
+}
+
+/**
+ * Write a string as a JSON string.
+ */
+static void writeTraceString(FILE* file, const char* str) {
+    fputc('"', file);
+    for (; *str != '\0'; str++) {
+        // escape quotes and backslashes, and drop control characters
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', file);
+            fputc(*str, file);
+        }
+        else if ((unsigned char) *str >= ' ') {
+            fputc(*str, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write an event in Chrome trace event format, with times in microseconds.
+ */
+static void writeTraceEvent(FILE* file, const char* name, const char* category, double start, double wall, double cpu, int thread) {
+    fprintf(file, "{\"name\":");
+    writeTraceString(file, name);
+    fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":%d,\"tid\":%d,\"args\":{\"cpu_ms\":%.3f}}",
+            category, start * 1e6, wall * 1e6, (int) tracePid, thread, cpu * 1e3);
+}
+
+/**
+ * Write the trace file, and print a summary of the phases to stderr.
+ * The whole run is recorded as an event enclosing all others.
+ */
+void writeTrace() {
+    TraceMark end = currentTraceTime();
+    double wall = end.wall - traceStart.wall;
+    double cpu = end.cpu - traceStart.cpu + end.childCpu - traceStart.childCpu;
+
+    FILE* file = fopen(tracePath, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to write trace file: %s\n", tracePath);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    writeTraceEvent(file, "brainfuck", "phase", 0, wall, cpu, 1);
+    for (int i = 0; i < traceEventCount; i++) {
+        TraceEvent* event = &traceEvents[i];
+        fprintf(file, ",\n");
+        writeTraceEvent(file, event->name, event->category, event->start, event->wall, event->cpu, event->thread);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    // phases in order, with passes and commands summed up
+    double passTime = 0, commandTime = 0;
+    int commandCount = 0;
+    fprintf(stderr, "Trace:");
+    for (int i = 0; i < traceEventCount; i++) {
+        TraceEvent* event = &traceEvents[i];
+        if (strcmp(event->category, "pass") == 0) {
+            passTime += event->wall;
+        }
+        else if (strcmp(event->category, "command") == 0) {
+            commandTime += event->wall;
+            commandCount++;
+        }
+        else {
+            fprintf(stderr, " %s %.1f ms,", event->name, event->wall * 1e3);
+        }
+    }
+    fprintf(stderr, " passes %.1f ms, %d commands %.1f ms, total %.1f ms wall %.1f ms CPU [%s]\n",
+            passTime * 1e3, commandCount, commandTime * 1e3, wall * 1e3, cpu * 1e3, tracePath);
+}
+
+/**
+ * Write the trace if tracing, and free the recorded events.
+ * Only the traced process writes it, not forked pipeline stages or checkpoints.
+ */
+void cleanupTrace() {
+    if (tracePath != NULL && getpid() == tracePid) {
+        writeTrace();
+    }
+    tracePath = NULL;
+
+    for (int i = 0; i < traceEventCount; i++) {
+        free(traceEvents[i].name);
+    }
+    free(traceEvents);
+    traceEvents = NULL;
+    traceEventCount = 0;
+    traceEventCapacity = 0;
+}
+
+#endif // BFTRACE_H
@@ -24,6 +24,108 @@
 
 #define MIN_MEMORY_SIZE   1000
 #define MIN_STACK_SIZE  100
+#define MIN_THREAD_COUNT  1
+#define MAX_OPTIMIZATION_LEVEL  3
+
+// memory mapping, processes, and shared objects are only available on POSIX systems
+#if defined(__unix__) || defined(__APPLE__)
+#define POSIX_SYSTEM
+#endif
+
+// optimization passes in the order they are run
+#define PASS_COMPACT        0
+#define PASS_IDIOMS         1
+#define PASS_LOOPS          2
+#define PASS_CONDITIONALS   3
+#define PASS_CONSTANTS      4
+#define PASS_RUNS           5
+#define PASS_FUSE           6
+#define PASS_COUNT          7
+
+// most cell values tracked at once by constant propagation
+#define MAX_TRACKED_CELLS  64
+
+// most cells changed by a loop converted into multiply-adds
+#define MAX_LOOP_CELLS  16
+
+// net movement of a loop body which is not fixed
+#define LOOP_UNBALANCED  INT_MIN
+
+// span of cells and least cells updated by a combined run of updates
+#define MAX_RUN_SIZE  64
+#define MIN_RUN_CELLS  4
+
+// most operations scanned for a run of updates
+#define MAX_RUN_SCAN  (4 * MAX_RUN_SIZE)
+
+// number of entries and iterations after which a loop is compiled in tiered execution
+#define HOT_LOOP_THRESHOLD  10000
+
+// most hot loops waiting to be compiled at once
+#define MAX_HOT_LOOPS  64
+
+// seconds between periodic checkpoints of execution
+#define DEFAULT_CHECKPOINT_INTERVAL  60
+#define MIN_CHECKPOINT_INTERVAL  1
+
+// size of the ring buffer between pipeline stages, a power of two
+#define PIPELINE_BUFFER_SIZE  (1 << 16)
+
+// characters a pipeline stage passes on before waking the next one
+#define PIPELINE_BATCH_SIZE  (1 << 12)
+
+// size of a cache line, to keep data written by different threads apart
+#define CACHE_LINE_SIZE  64
+
+// operations in a function of translated C, and in a translated C file
+#define MAX_C_FUNCTION_SIZE  1000
+#define MAX_C_UNIT_SIZE  10000
+
+// most C files a translated program is split into
+#define MAX_C_UNIT_COUNT  16
+
+// size of the input and output buffers of a freestanding program
+#define FREESTANDING_BUFFER_SIZE  (1 << 12)
+
+// gcc flags to compile and link a freestanding program without libc
+#define FREESTANDING_CFLAGS   "-ffreestanding -fno-stack-protector -fno-asynchronous-unwind-tables -fno-pie"
+#define FREESTANDING_LDFLAGS  "-static -nostdlib -no-pie -s -Wl,--gc-sections -Wl,--build-id=none -Wl,-z,noseparate-code -lgcc"
+
+// size of the input and output buffers of a native program
+#define NATIVE_BUFFER_SIZE  (1 << 12)
+
+// gcc flags to compile and link a native program into a shared object
+#define NATIVE_CFLAGS   "-O2 -fPIC -fvisibility=hidden"
+#define NATIVE_LDFLAGS  "-shared"
+
+// directory of shared objects of native programs, within the cache directory
+#define NATIVE_CACHE_DIRECTORY  "brainfuck"
+
+// most cells a memoized loop may use, and least operations it must have
+#define MAX_MEMO_WINDOW  32
+#define MIN_MEMO_LOOP_SIZE  8
+
+// results of loops cached when memoizing, a power of two
+#define MEMO_CACHE_SIZE  (1 << 12)
+
+// misses after which a loop stops being memoized if it misses
+// more than MEMO_MISS_RATIO times as often as it hits
+// or runs fewer than MIN_MEMO_WORK operations on average
+#define MEMO_PROBATION  1024
+#define MEMO_MISS_RATIO  8
+#define MIN_MEMO_WORK  64
+
+// size of the input and output buffers of a resumable execution
+#define EXECUTION_BUFFER_SIZE  4096
+
+// operations a served session runs before yielding to others
+#define SESSION_STEP_BUDGET  (1 << 16)
+
+// events handled by the server at a time
+#define SERVER_EVENT_COUNT  64
+
+// smallest source chunk worth pre-processing in its own thread
+#define MIN_CHUNK_SIZE  (1 << 20)
 
 #define NO_JUMP          0
 #define SET_ZERO        '!'
@@ -31,25 +133,89 @@
 #define SCAN_ZERO_RIGHT '#'
 #define ADDRESS         '$'
 #define DATA            '%'
+#define IF_OPEN         '('
+#define IF_CLOSE        ')'
+#define SET_VALUE       '='
+#define OUTPUT_CONST    '"'
+#define UPDATE_RUN      ';'
+#define MULTIPLY_ADD    ':'
+#define AFFINE_LOOP     '?'
+
+// superinstructions fused from frequent operation sequences
+#define ADDRESS_DATA       '&'
+#define DATA_ADDRESS       '*'
+#define ADDRESS_SET_ZERO   '^'
+#define ADDRESS_SET_VALUE  '_'
+#define ADDRESS_LOOP_OPEN  '{'
+#define ADDRESS_LOOP_CLOSE '}'
+#define LOOP_DATA_ADDRESS  '~'
+#define ADDRESS_SCAN_ZERO  '|'
+#define MULTIPLY_ADD_SET_ZERO  '/'
 
-#define isOperator(ch) (strchr("<>+-,.[]", ch) != NULL)
+// lookup table of brainfuck operators
+static const char operators[256] = {
+    ['<'] = 1, ['>'] = 1, ['+'] = 1, ['-'] = 1,
+    [','] = 1, ['.'] = 1, ['['] = 1, [']'] = 1
+};
+
+#define isOperator(ch) (operators[(unsigned char) (ch)])
 
 static int MEMORY_SIZE;
 
 static int STACK_SIZE;
 
+static int THREAD_COUNT;
+
 char* programExecutablePath;
 
+char* processed;
+
+int processedFileSize;
+
 int* jumps;
 
+int* operands;
+
+unsigned char* constants;
+
 int filePointer;
 
 unsigned char* memory;
 
+long memoryPageSize;
+
+long memoryPageCount;
+
 int pointer;
 
+long long inputOffset;
+
+long long outputOffset;
+
+int pipelineFlag;
+
+int freestandingFlag;
+
+int nativeFlag;
+
 int findZeroLeft(int position);
 
 int findZeroRight(int position);
 
+int tripCountFactor(int step);
+
+int loopStep(int position);
+
+void execute(char* filePath);
+
+int executeCommand(const char *cmd);
+
+char* generateCUnitFilePath(char* filePath, int unit);
+
+int compileUnits(char* filePath, char* outputPath, const char* compileFlags, const char* linkFlags);
+
+double currentTime();
+
+int findTouchedPages(unsigned char* touched);
+
 #endif // COMMONS_H
@@ -22,11 +22,26 @@
 #include <string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "stack.h"
 #include "commons.h"
 #include "bfi.h"
 #include "bftoc.h"
+#include "bfjit.h"
+#include "bfmemo.h"
+#include "bfnative.h"
+#include "bfstats.h"
+#include "bftrace.h"
+#include "bfcheckpoint.h"
+#include "bfsession.h"
+
+#ifdef POSIX_SYSTEM
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 
 // size of memory to be used by the interpreter
 static int MEMORY_SIZE = 30000;
@@ -34,6 +49,36 @@ static int MEMORY_SIZE = 30000;
 // size of stack to be used by the interpreter
 static int STACK_SIZE = 1000;
 
+// number of threads to be used to pre-process the source file
+static int THREAD_COUNT = 1;
+
+// report pre-processing throughput and execution time
+int benchmarkFlag = 0;
+
+// interpret and compile hot loops in the background
+int tieredFlag = 0;
+
+// report hardware performance counter statistics of execution
+int statsFlag = 0;
+
+// replay cached results of loops run again with the same cells
+int memoizeFlag = 0;
+
+// report time and effect of each optimization pass
+int optReportFlag = 0;
+
+// run source files as stages of a pipeline
+int pipelineFlag = 0;
+
+// translate to C programs which do not use libc
+int freestandingFlag = 0;
+
+// run the program compiled to a shared object
+int nativeFlag = 0;
+
+// optimization passes to be run, indexed by PASS_ constants
+int passEnabled[PASS_COUNT];
+
 // source file stored in memory for fast access
 char* source = NULL;
 
@@ -52,12 +97,29 @@ int filePointer = 0;
 // jumps and flags are preinitialized for optimized execution
 int* jumps = NULL;
 
+// second operand of superinstructions
+int* operands = NULL;
+
+// constant output values found by constant propagation
+unsigned char* constants = NULL;
+
+// size of constant output values in chars
+int constantsSize = 0;
+
 // the brainfuck memory - 0-255 - circular
 unsigned char* memory = NULL;
 
+// size of a page of memory, and number of pages of memory
+long memoryPageSize = 0;
+long memoryPageCount = 0;
+
 // pointer to current location in memory
 int pointer = 0;
 
+// characters read from stdin and written to stdout, recorded by checkpoints
+long long inputOffset = 0;
+long long outputOffset = 0;
+
 // loop stack
 Stack* stack = NULL;
 
@@ -111,60 +173,57 @@ void loadFile(char* filePath) {
 }
 
 /**
- * Initialize the jumps in the file for optimization.
- * Jumps between [ and ].
- * Compacts and jumps consecutive > and <.
- * Compacts and jumps consecutive + and -.
- * Optimizes [-] to set(0).
- * Optimizes [<] to scan_left(0).
- * Optimizes [>] to scan_right(0).
+ * A chunk of the source file to be pre-processed independently.
  */
-void initJumps() {
-    // initialize pre-processed source and jumps
-    processed = (char*) malloc(sizeof(char) * (fileSize));
-    jumps = (int*) malloc(sizeof(int) * (fileSize));
+typedef struct Chunk {
+    int start;      // first character of the chunk in source
+    int end;        // character after the last of the chunk in source
+    int size;       // number of operations in the chunk
+    int offset;     // first operation of the chunk in pre-processed source
+    Stack* opens;   // local indexes of [ unmatched within the chunk
+    Stack* closes;  // local indexes of ] unmatched within the chunk
+} Chunk;
 
-    // create a stack for [ operators
-    stack = stackCreate(STACK_SIZE);
+/**
+ * Pre-process a chunk of the source file.
+ * Operations are written from index start of pre-processed source and jumps.
+ * Jumps between [ and ] are local to the chunk, unmatched ones are recorded.
+ * The compact pass is run here as it is cheapest while reading the source.
+ */
+void initChunk(Chunk* chunk) {
+    char* out = processed + chunk->start;
+    int* outJumps = jumps + chunk->start;
+    int end = chunk->end;
+
+    // compact consecutive operations while reading them
+    int compact = passEnabled[PASS_COMPACT];
 
     // find jumps to optimize code
     int i, index;
-    for (i = 0, index = 0; i < fileSize; i++, index++) {
+    for (i = chunk->start, index = 0; i < end; i++, index++) {
         // get one character
         char ch = source[i];
 
         // create jumps for opening and closing square brackets [ and ]
         if (ch == '[') {
-            char ch2 = i + 1 < fileSize ? source[i + 1] : -1;
-            char ch3 = i + 2 < fileSize ? source[i + 2] : -1;
-            if (ch2 == '-' && ch3 == ']') {
-                // optimize [-] to set(0)
-                processed[index] = SET_ZERO;
-                i += 2;
-            }
-            else if (ch2 == '<' && ch3 == ']') {
-                // optimize [<] to scan_left(0)
-                processed[index] = SCAN_ZERO_LEFT;
-                i += 2;
-            }
-            else if (ch2 == '>' && ch3 == ']') {
-                // optimize [>] to scan_right(0)
-                processed[index] = SCAN_ZERO_RIGHT;
-                i += 2;
+            // push opening bracket [ to stack
+            out[index] = ch;
+            stackPush(chunk->opens, index);
+        }
+        else if (ch == ']') {
+            out[index] = ch;
+
+            if (stackEmpty(chunk->opens)) {
+                // opening bracket is in a previous chunk
+                stackPush(chunk->closes, index);
             }
             else {
-                // push opening bracket [ to stack
-                processed[index] = ch;
-                stackPush(stack, index);
+                // pop opening bracket and swap indexes in jump table
+                int x = stackPop(chunk->opens);
+                outJumps[x] = index;
+                outJumps[index] = x;
             }
         }
-        else if (ch == ']') {
-            // pop opening bracket and swap indexes in jump table
-            int x = stackPop(stack);
-            jumps[x] = index;
-            jumps[index] = x;
-            processed[index] = ch;
-        }
 
         // compact and jump for > and <
         else if (ch == '>' || ch == '<') {
@@ -173,7 +232,7 @@ void initJumps() {
             if (ch == '>') sum++;
             else sum--;
 
-            while (++i < fileSize) {
+            while (compact && ++i < end) {
                 if (source[i] == '>') {
                     sum++;
                 }
@@ -184,7 +243,7 @@ void initJumps() {
                     break;
                 }
             }
-            i--;
+            if (compact) i--;
 
             // optimize out address operations if sum is zero
             if (sum == 0) {
@@ -192,8 +251,8 @@ void initJumps() {
                 continue;
             }
 
-            processed[index] = ADDRESS;
-            jumps[index] = sum;
+            out[index] = ADDRESS;
+            outJumps[index] = sum;
         }
 
         // compact and jump for + and -
@@ -203,7 +262,7 @@ void initJumps() {
             if (ch == '+') sum++;
             else sum--;
 
-            while (++i < fileSize) {
+            while (compact && ++i < end) {
                 if (source[i] == '+') {
                     sum++;
                 }
@@ -214,22 +273,22 @@ void initJumps() {
                     break;
                 }
             }
-            i--;
+            if (compact) i--;
 
             // optimize out data operations if sum is zero
             // or next operator is an input operation
-            if (sum == 0 || source[i + 1] == ',') {
+            if (compact && (sum == 0 || source[i + 1] == ',')) {
                 index--;
                 continue;
             }
 
-            processed[index] = DATA;
-            jumps[index] = sum;
+            out[index] = DATA;
+            outJumps[index] = sum;
         }
 
         // input or output no jump
         else if (ch == ',' || ch == '.') {
-            processed[index] = ch;
+            out[index] = ch;
         }
 
         // for everything else, do not include in pre-processed source
@@ -238,11 +297,126 @@ void initJumps() {
         }
     }
 
+    // set size of pre-processed chunk
+    chunk->size = index;
+}
+
+/**
+ * Thread entry point to pre-process a chunk of the source file.
+ */
+void* initChunkThread(void* chunk) {
+    initChunk((Chunk*) chunk);
+    return NULL;
+}
+
+/**
+ * Initialize the jumps in the file for optimization.
+ * Jumps between [ and ].
+ * Compacts and jumps consecutive > and < (compact pass).
+ * Compacts and jumps consecutive + and - (compact pass).
+ * Large source files are split into chunks pre-processed in parallel,
+ * and loops spanning chunks are stitched together afterwards.
+ * Returns the number of chunks, each pre-processed by its own thread.
+ */
+int initJumps() {
+    // initialize pre-processed source and jumps
+    processed = (char*) malloc(sizeof(char) * (fileSize));
+    jumps = (int*) malloc(sizeof(int) * (fileSize));
+    operands = (int*) malloc(sizeof(int) * (fileSize));
+
+    // use a single thread unless every chunk is large enough
+    int threads = THREAD_COUNT;
+    if (threads > fileSize / MIN_CHUNK_SIZE) {
+        threads = fileSize / MIN_CHUNK_SIZE;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // split source into chunks starting at [ so that no optimization spans chunks
+    Chunk chunks[threads];
+    int count = 0;
+    for (int i = 0; i < threads; i++) {
+        int start = (int) ((long long) fileSize * i / threads);
+        if (i > 0) {
+            while (start < fileSize && source[start] != '[') start++;
+            if (start <= chunks[count - 1].start || start >= fileSize) continue;
+            chunks[count - 1].end = start;
+        }
+        chunks[count].start = start;
+        chunks[count].end = fileSize;
+        chunks[count].opens = stackCreate(STACK_SIZE);
+        chunks[count].closes = stackCreate(STACK_SIZE);
+        count++;
+    }
+
+    // pre-process the chunks
+    if (count == 1) {
+        initChunk(&chunks[0]);
+    }
+    else {
+        pthread_t workers[count];
+        for (int i = 0; i < count; i++) {
+            if (pthread_create(&workers[i], NULL, initChunkThread, &chunks[i]) != 0) {
+                // display error message and exit
+                fprintf(stderr, "Failed to create pre-processing thread\n");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+
+    // move chunks next to each other and relocate their jumps
+    int index = 0;
+    for (int i = 0; i < count; i++) {
+        Chunk* chunk = &chunks[i];
+        chunk->offset = index;
+        if (chunk->offset != chunk->start) {
+            memmove(processed + index, processed + chunk->start, sizeof(char) * chunk->size);
+            memmove(jumps + index, jumps + chunk->start, sizeof(int) * chunk->size);
+            for (int j = index; j < index + chunk->size; j++) {
+                if (processed[j] == '[' || processed[j] == ']') {
+                    jumps[j] += index;
+                }
+            }
+        }
+        index += chunk->size;
+    }
+
     // set size of pre-processed file
     processedFileSize = index;
 
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    // stitch loops spanning chunks
+    int unmatched = 0;
+    for (int i = 0; i < count; i++) {
+        Chunk* chunk = &chunks[i];
+
+        // unmatched ] come before unmatched [ within a chunk
+        for (int j = 0; j <= chunk->closes->tos; j++) {
+            if (stackEmpty(stack)) {
+                unmatched = 1;
+                break;
+            }
+            int x = stackPop(stack);
+            int y = chunk->offset + chunk->closes->array[j];
+            jumps[x] = y;
+            jumps[y] = x;
+        }
+        for (int j = 0; j <= chunk->opens->tos; j++) {
+            stackPush(stack, chunk->offset + chunk->opens->array[j]);
+        }
+
+        stackFree(chunk->opens);
+        stackFree(chunk->closes);
+    }
+
     // loops are unmatched
-    if (!stackEmpty(stack)) {
+    if (unmatched || !stackEmpty(stack)) {
         // free stack
         stackFree(stack);
         stack = NULL;
@@ -252,9 +426,1091 @@ void initJumps() {
         exit(1);
     }
 
-    // free stack
-    stackFree(stack);
-    stack = NULL;
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+
+    return count;
+}
+
+/**
+ * Optimize loop idioms.
+ * Optimizes [-] to set(0), and any other odd change as it always reaches zero.
+ * Optimizes [<] to scan_left(0).
+ * Optimizes [>] to scan_right(0).
+ */
+void initIdioms() {
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    int i, index;
+    for (i = 0, index = 0; i < processedFileSize; i++, index++) {
+        // get one operation and the two following it
+        char ch = processed[i];
+        char ch2 = i + 1 < processedFileSize ? processed[i + 1] : -1;
+        char ch3 = i + 2 < processedFileSize ? processed[i + 2] : -1;
+
+        if (ch == '[' && ch2 == DATA && ch3 == ']' && (jumps[i + 1] & 1)) {
+            // optimize [-] to set(0)
+            processed[index] = SET_ZERO;
+            i += 2;
+        }
+        else if (ch == '[' && ch2 == ADDRESS && ch3 == ']' && jumps[i + 1] == -1) {
+            // optimize [<] to scan_left(0)
+            processed[index] = SCAN_ZERO_LEFT;
+            i += 2;
+        }
+        else if (ch == '[' && ch2 == ADDRESS && ch3 == ']' && jumps[i + 1] == 1) {
+            // optimize [>] to scan_right(0)
+            processed[index] = SCAN_ZERO_RIGHT;
+            i += 2;
+        }
+        else if (ch == '[') {
+            // push opening bracket [ to stack
+            processed[index] = ch;
+            stackPush(stack, index);
+        }
+        else if (ch == ']') {
+            // pop opening bracket and swap indexes in jump table
+            int x = stackPop(stack);
+            jumps[x] = index;
+            jumps[index] = x;
+            processed[index] = ch;
+        }
+        else {
+            processed[index] = ch;
+            jumps[index] = jumps[i];
+            operands[index] = operands[i];
+        }
+    }
+
+    // set size of pre-processed file
+    processedFileSize = index;
+
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+}
+
+/**
+ * Find the factor which gives the trip count of a loop from its counter.
+ * A loop changing its counter by an odd step runs counter * factor times,
+ * wrapping around 256, as every odd step has an inverse modulo 256.
+ * Returns 0 if the step is even.
+ */
+int tripCountFactor(int step) {
+    for (int factor = 1; factor < 256; factor += 2) {
+        if (((step * factor) & 0xFF) == 255) {
+            return factor;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Find the distance from one offset forward to another, wrapping around the memory.
+ */
+static inline int cellDistance(int to, int from) {
+    int distance = (to - from) % MEMORY_SIZE;
+    return distance < 0 ? distance + MEMORY_SIZE : distance;
+}
+
+/**
+ * Scan operations from start to end for their net pointer movement and for
+ * how they change the cell at target.
+ * Offsets are relative to the pointer at the start of the outermost loop.
+ * Changes of the target by + and - outside nested loops are added to step,
+ * and any other change of the target sets other.
+ * Returns LOOP_UNBALANCED if the movement is not fixed, which includes nested
+ * loops and conditionals with net movement, or is too large to compare offsets.
+ */
+static int scanLoopBody(int start, int end, int offset, int target, int nested, int* step, int* other) {
+    for (int i = start; i < end; i++) {
+        char ch = processed[i];
+
+        if (ch == ADDRESS) {
+            offset += jumps[i];
+            if (offset >= MEMORY_SIZE / 2 || offset <= -MEMORY_SIZE / 2) {
+                return LOOP_UNBALANCED;
+            }
+        }
+        else if (ch == DATA) {
+            if (offset == target && nested) *other = 1;
+            else if (offset == target) *step += jumps[i];
+        }
+        else if (ch == SET_ZERO || ch == SET_VALUE || ch == ',') {
+            if (offset == target) *other = 1;
+        }
+        else if (ch == MULTIPLY_ADD) {
+            if (cellDistance(offset + jumps[i], target) == 0) *other = 1;
+        }
+        else if (ch == UPDATE_RUN) {
+            if (cellDistance(target, offset) < operands[i]) *other = 1;
+        }
+        else if (ch == AFFINE_LOOP) {
+            int offsets[MAX_LOOP_CELLS];
+            readAffineOffsets(constants + jumps[i], operands[i], offsets);
+            for (int j = 0; j < operands[i]; j++) {
+                if (cellDistance(offset + offsets[j], target) == 0) *other = 1;
+            }
+        }
+        else if (ch == '[' || ch == IF_OPEN) {
+            if (scanLoopBody(i + 1, jumps[i], offset, target, 1, step, other) != offset) {
+                return LOOP_UNBALANCED;
+            }
+            i = jumps[i];
+        }
+        else if (ch != '.' && ch != OUTPUT_CONST) {
+            // scans and superinstructions
+            return LOOP_UNBALANCED;
+        }
+    }
+    return offset;
+}
+
+/**
+ * Find the step by which a loop changes its counter in each iteration, if its
+ * trip count can be computed from the counter on entry.
+ * The loop must have no net movement, and change its counter only with + and -
+ * outside nested loops, by an odd step in total.
+ * Returns 0 otherwise.
+ */
+int loopStep(int position) {
+    int step = 0, other = 0;
+    if (scanLoopBody(position + 1, jumps[position], 0, 0, 0, &step, &other) != 0 || other) {
+        return 0;
+    }
+    return tripCountFactor(step) != 0 ? step : 0;
+}
+
+/**
+ * The effect of an iteration of a loop on the cells it uses, as an affine map.
+ * Each cell becomes a sum of multiples of the cells before the iteration and
+ * a constant, modulo 256.
+ */
+typedef struct AffineMap {
+    int size;                                           // number of cells, the counter first
+    int offsets[MAX_LOOP_CELLS];                        // offsets of the cells from the pointer
+    int rows[MAX_LOOP_CELLS][MAX_LOOP_CELLS + 1];       // multiples of each cell, the constant last
+} AffineMap;
+
+/**
+ * Find the cell of an affine map at offset, adding it if it is not used yet.
+ * Returns -1 if the map has too many cells.
+ */
+static int findAffineCell(AffineMap* map, int offset) {
+    for (int i = 0; i < map->size; i++) {
+        if (map->offsets[i] == offset) {
+            return i;
+        }
+    }
+    if (map->size == MAX_LOOP_CELLS) {
+        return -1;
+    }
+
+    // a cell not changed yet keeps its value
+    int cell = map->size++;
+    map->offsets[cell] = offset;
+    memset(map->rows[cell], 0, sizeof(map->rows[cell]));
+    map->rows[cell][cell] = 1;
+    return cell;
+}
+
+/**
+ * Find the affine map of an iteration of a loop whose body, from start to end,
+ * only holds +, -, <, >, set(value), and multiply-adds, with no net movement.
+ * Nested loops are summarized before the loops they are in, so multiply-adds
+ * include nested loops which only change cells by constants.
+ * Returns the step by which an iteration changes the counter if it is odd and
+ * the counter does not depend on other cells, and 0 otherwise.
+ */
+int summarizeLoop(int start, int end, AffineMap* map) {
+    map->size = 0;
+    findAffineCell(map, 0);
+
+    int offset = 0;
+    for (int i = start; i < end; i++) {
+        char ch = processed[i];
+
+        if (ch == ADDRESS) {
+            offset += jumps[i];
+            if (offset >= MEMORY_SIZE / 2 || offset <= -MEMORY_SIZE / 2) return 0;
+            continue;
+        }
+
+        int cell = findAffineCell(map, offset);
+        if (cell == -1) return 0;
+
+        if (ch == DATA) {
+            map->rows[cell][MAX_LOOP_CELLS] += jumps[i];
+        }
+        else if (ch == SET_ZERO || ch == SET_VALUE) {
+            memset(map->rows[cell], 0, sizeof(map->rows[cell]));
+            map->rows[cell][MAX_LOOP_CELLS] = ch == SET_VALUE ? jumps[i] : 0;
+        }
+        else if (ch == MULTIPLY_ADD && offset + jumps[i] < MEMORY_SIZE / 2 && offset + jumps[i] > -MEMORY_SIZE / 2) {
+            int target = findAffineCell(map, offset + jumps[i]);
+            if (target == -1) return 0;
+            for (int j = 0; j <= MAX_LOOP_CELLS; j++) {
+                map->rows[target][j] = (map->rows[target][j] + operands[i] * map->rows[cell][j]) & 0xFF;
+            }
+        }
+        else {
+            return 0;
+        }
+    }
+    if (offset != 0) {
+        return 0;
+    }
+
+    // the counter must only change by its step
+    for (int j = 0; j < MAX_LOOP_CELLS; j++) {
+        if ((map->rows[0][j] & 0xFF) != (j == 0)) return 0;
+    }
+    int step = map->rows[0][MAX_LOOP_CELLS] & 0xFF;
+    return tripCountFactor(step) != 0 ? step : 0;
+}
+
+/**
+ * Check if an affine map only adds constants to cells.
+ */
+static int isTranslation(AffineMap* map) {
+    for (int i = 0; i < map->size; i++) {
+        for (int j = 0; j < map->size; j++) {
+            if ((map->rows[i][j] & 0xFF) != (i == j)) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Compose two affine maps into result, applying second and then first.
+ * The maps must have the same cells.
+ */
+static void composeAffineMaps(AffineMap* result, AffineMap* first, AffineMap* second) {
+    AffineMap composed = *first;
+    for (int i = 0; i < first->size; i++) {
+        for (int j = 0; j <= MAX_LOOP_CELLS; j++) {
+            int value = j == MAX_LOOP_CELLS ? first->rows[i][j] : 0;
+            for (int k = 0; k < first->size; k++) {
+                value += first->rows[i][k] * second->rows[k][j];
+            }
+            composed.rows[i][j] = value & 0xFF;
+        }
+    }
+    *result = composed;
+}
+
+/**
+ * Write a loop which only adds constants to cells as multiply-adds of its
+ * counter into the cells followed by set(0), from position.
+ * Each cell is added its change in an iteration times the trip count.
+ * Returns the position of the last operation written.
+ */
+int writeMultiplyAdds(int position, AffineMap* map, int factor) {
+    for (int i = 1; i < map->size; i++) {
+        // cells whose change wraps around to zero are not added to
+        int product = (map->rows[i][MAX_LOOP_CELLS] * factor) & 0xFF;
+        if (product != 0) {
+            processed[position] = MULTIPLY_ADD;
+            jumps[position] = map->offsets[i];
+            operands[position] = product;
+            position++;
+        }
+    }
+    processed[position] = SET_ZERO;
+    return position;
+}
+
+/**
+ * Write a loop whose iteration is an affine map as a single affine loop at position.
+ * Its data is stored in constants as the int offsets of its cells, the trip count
+ * factor, and the map raised to the powers 1, 2, 4, and so on up to 128, each a
+ * row per cell of a multiple per cell followed by the constant.
+ * Returns the position of the operation written.
+ */
+int writeAffineLoop(int position, AffineMap* map, int factor, int* capacity) {
+    int size = map->size;
+    int length = sizeof(int) * size + 1 + 8 * size * (size + 1);
+    if (constantsSize + length > *capacity) {
+        *capacity = 2 * (constantsSize + length);
+        constants = (unsigned char*) realloc(constants, sizeof(unsigned char) * (*capacity));
+    }
+
+    processed[position] = AFFINE_LOOP;
+    jumps[position] = constantsSize;
+    operands[position] = size;
+
+    memcpy(constants + constantsSize, map->offsets, sizeof(int) * size);
+    constantsSize += sizeof(int) * size;
+    constants[constantsSize++] = factor;
+
+    AffineMap power = *map;
+    for (int bit = 0; bit < 8; bit++) {
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                constants[constantsSize++] = power.rows[i][j] & 0xFF;
+            }
+            constants[constantsSize++] = power.rows[i][MAX_LOOP_CELLS] & 0xFF;
+        }
+        composeAffineMaps(&power, &power, &power);
+    }
+    return position;
+}
+
+/**
+ * Evaluate loops whose trip count is known on entry in closed form.
+ * Loops are summarized from the innermost out, as affine maps of an iteration.
+ * A loop which only changes cells by constants, such as [->+>---<<], is
+ * converted into multiply-adds of its counter into the cells followed by set(0).
+ * Other affine loops, such as the multiplication [>[->+>+<<]>>[-<<+>>]<<<-],
+ * are converted into an affine loop applying the powers of two of their map
+ * for the bits of their trip count, which takes at most 8 steps.
+ * Multiply-adds and affine loops of known cells are folded further by
+ * propagateConstants().
+ */
+void evaluateLoops() {
+    AffineMap map;
+    int capacity = constantsSize;
+
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    int i, index;
+    for (i = 0, index = 0; i < processedFileSize; i++, index++) {
+        char ch = processed[i];
+
+        if (ch == '[' || ch == IF_OPEN) {
+            // push opening bracket [ to stack
+            processed[index] = ch;
+            stackPush(stack, index);
+        }
+        else if (ch == ']') {
+            // the body has already been written, with its nested loops summarized
+            int x = stackPop(stack);
+            int step = summarizeLoop(x + 1, index, &map);
+
+            if (step != 0 && isTranslation(&map)) {
+                // the body changes the counter and each cell added to, so the source never grows
+                index = writeMultiplyAdds(x, &map, tripCountFactor(step));
+            }
+            else if (step != 0) {
+                index = writeAffineLoop(x, &map, tripCountFactor(step), &capacity);
+            }
+            else {
+                // swap indexes in jump table
+                jumps[x] = index;
+                jumps[index] = x;
+                processed[index] = ch;
+            }
+        }
+        else if (ch == IF_CLOSE) {
+            // pop opening bracket and swap indexes in jump table
+            int x = stackPop(stack);
+            jumps[x] = index;
+            jumps[index] = x;
+            processed[index] = ch;
+        }
+        else {
+            processed[index] = ch;
+            jumps[index] = jumps[i];
+            operands[index] = operands[i];
+        }
+    }
+
+    // set size of pre-processed file
+    processedFileSize = index;
+
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+}
+
+/**
+ * Convert loops which run at most once into conditionals.
+ * A loop runs at most once if the current cell is provably zero at its ],
+ * that is if its body ends with [-], [<], [>], or another loop or conditional.
+ */
+void initConditionals() {
+    for (int i = 1; i < processedFileSize; i++) {
+        if (processed[i] == ']') {
+            char ch = processed[i - 1];
+            if (ch == SET_ZERO || ch == SCAN_ZERO_LEFT || ch == SCAN_ZERO_RIGHT || ch == ']' || ch == IF_CLOSE) {
+                processed[jumps[i]] = IF_OPEN;
+                processed[i] = IF_CLOSE;
+            }
+        }
+    }
+}
+
+/**
+ * A cell whose value is known while propagating constants.
+ */
+typedef struct Cell {
+    int offset;     // offset of the cell from the pointer at the start of the block
+    int value;      // known value of the cell
+    int dirty;      // value is yet to be written to memory
+} Cell;
+
+/**
+ * State of constant propagation within a basic block.
+ */
+typedef struct Tracker {
+    Cell cells[MAX_TRACKED_CELLS];
+    int count;      // number of known cells
+    int zeroed;     // cells which are not known are zero (start of program)
+    int offset;     // offset of the pointer from the start of the block
+    int moved;      // offset of the pointer already written to pre-processed source
+    char* out;
+    int* outJumps;
+    int* outOperands;
+    int size;
+} Tracker;
+
+/**
+ * Write an operation to the propagated pre-processed source.
+ */
+static inline void emitOperation(Tracker* tracker, char ch, int jump, int operand) {
+    tracker->out[tracker->size] = ch;
+    tracker->outJumps[tracker->size] = jump;
+    tracker->outOperands[tracker->size] = operand;
+    tracker->size++;
+}
+
+/**
+ * Write pending pointer movement to the propagated pre-processed source.
+ */
+static inline void emitMove(Tracker* tracker, int offset) {
+    if (offset != tracker->moved) {
+        emitOperation(tracker, ADDRESS, offset - tracker->moved, 0);
+        tracker->moved = offset;
+    }
+}
+
+/**
+ * Find a known cell at offset, or return NULL if its value is unknown.
+ */
+static inline Cell* findCell(Tracker* tracker, int offset) {
+    for (int i = 0; i < tracker->count; i++) {
+        if (tracker->cells[i].offset == offset) {
+            return &tracker->cells[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Write the pending value of a known cell.
+ */
+static inline void writeCell(Tracker* tracker, Cell* cell) {
+    emitMove(tracker, cell->offset);
+    if (cell->value == 0) emitOperation(tracker, SET_ZERO, 0, 0);
+    else emitOperation(tracker, SET_VALUE, cell->value, 0);
+    cell->dirty = 0;
+}
+
+/**
+ * Write all pending cell values and pointer movement, and forget known cells.
+ */
+void flushCells(Tracker* tracker) {
+    for (int i = 0; i < tracker->count; i++) {
+        Cell* cell = &tracker->cells[i];
+        if (cell->dirty) {
+            writeCell(tracker, cell);
+        }
+        // unknown cells can only be assumed zero if no known cell differs
+        if (cell->value != 0) tracker->zeroed = 0;
+    }
+    emitMove(tracker, tracker->offset);
+
+    // start a new block at the current pointer
+    tracker->count = 0;
+    tracker->offset = 0;
+    tracker->moved = 0;
+}
+
+/**
+ * Set a known cell value, writing pending cells first if too many are known.
+ */
+void setCell(Tracker* tracker, int value, int dirty) {
+    Cell* cell = findCell(tracker, tracker->offset);
+    if (cell == NULL) {
+        if (tracker->count == MAX_TRACKED_CELLS) {
+            flushCells(tracker);
+        }
+        cell = &tracker->cells[tracker->count++];
+        cell->offset = tracker->offset;
+    }
+    cell->value = value & 0xFF;
+    cell->dirty = dirty;
+}
+
+/**
+ * Forget the known value of the current cell.
+ */
+void forgetCell(Tracker* tracker) {
+    Cell* cell = findCell(tracker, tracker->offset);
+    if (cell != NULL) {
+        *cell = tracker->cells[--tracker->count];
+    }
+    tracker->zeroed = 0;
+}
+
+/**
+ * Check if all cells of an affine loop are known, and near enough to be tracked.
+ */
+int isAffineLoopKnown(Tracker* tracker, int position) {
+    int offsets[MAX_LOOP_CELLS];
+    readAffineOffsets(constants + jumps[position], operands[position], offsets);
+    for (int i = 0; i < operands[position]; i++) {
+        int offset = tracker->offset + offsets[i];
+        if (offset >= MEMORY_SIZE / 2 || offset <= -MEMORY_SIZE / 2) return 0;
+        if (findCell(tracker, offset) == NULL && !tracker->zeroed) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Propagate known cell values within basic blocks.
+ * Folds [-] followed by + and - into set(value).
+ * Converts output of known values into output of constants,
+ * and coalesces consecutive constant outputs into a single write.
+ * Removes loops and conditionals which are never entered.
+ * Folds multiply-adds and affine loops of known values, evaluating loops with
+ * known trip counts.
+ * Writes of known values are deferred until the pointer leaves the cell.
+ */
+void propagateConstants() {
+    Tracker tracker;
+    tracker.count = 0;
+    tracker.zeroed = 1;
+    tracker.offset = 0;
+    tracker.moved = 0;
+    tracker.size = 0;
+
+    // flushing may write a pointer movement in addition to each operation
+    // an affine loop evaluated on known cells may leave each of its cells to be written
+    int capacity = 2 * processedFileSize + 1;
+    for (int i = 0; i < processedFileSize; i++) {
+        if (processed[i] == AFFINE_LOOP) capacity += 2 * MAX_LOOP_CELLS + 1;
+    }
+    tracker.out = (char*) malloc(sizeof(char) * (capacity));
+    tracker.outJumps = (int*) malloc(sizeof(int) * (capacity));
+    tracker.outOperands = (int*) malloc(sizeof(int) * (capacity));
+
+    // make room for constant outputs after constants of earlier passes
+    constants = (unsigned char*) realloc(constants, sizeof(unsigned char) * (constantsSize + processedFileSize + 1));
+
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    for (int i = 0; i < processedFileSize; i++) {
+        char ch = processed[i];
+        Cell* cell = findCell(&tracker, tracker.offset);
+        int known = cell != NULL || tracker.zeroed;
+        int value = cell != NULL ? cell->value : 0;
+
+        if (ch == ADDRESS) {
+            // write the pending value before leaving the cell
+            // deferring it further would cost extra pointer movement
+            if (cell != NULL && cell->dirty) {
+                writeCell(&tracker, cell);
+            }
+
+            tracker.offset += jumps[i];
+
+            // do not let offsets alias around the memory
+            if (tracker.offset >= MEMORY_SIZE / 2 || tracker.offset <= -MEMORY_SIZE / 2) {
+                flushCells(&tracker);
+            }
+        }
+        else if (ch == DATA) {
+            if (known) {
+                setCell(&tracker, value + jumps[i], 1);
+            }
+            else {
+                emitMove(&tracker, tracker.offset);
+                emitOperation(&tracker, DATA, jumps[i], 0);
+            }
+        }
+        else if (ch == SET_ZERO) {
+            if (!known || value != 0) {
+                setCell(&tracker, 0, 1);
+            }
+        }
+        else if (ch == '.') {
+            if (known) {
+                // extend the previous constant output if possible
+                if (tracker.size > 0 && tracker.out[tracker.size - 1] == OUTPUT_CONST) {
+                    tracker.outOperands[tracker.size - 1]++;
+                }
+                else {
+                    emitOperation(&tracker, OUTPUT_CONST, constantsSize, 1);
+                }
+                constants[constantsSize++] = value;
+            }
+            else {
+                emitMove(&tracker, tracker.offset);
+                emitOperation(&tracker, ch, 0, 0);
+            }
+        }
+        else if (ch == ',') {
+            forgetCell(&tracker);
+            emitMove(&tracker, tracker.offset);
+            emitOperation(&tracker, ch, 0, 0);
+        }
+        else if (ch == MULTIPLY_ADD && tracker.offset + jumps[i] < MEMORY_SIZE / 2 && tracker.offset + jumps[i] > -MEMORY_SIZE / 2) {
+            int target = tracker.offset + jumps[i];
+            Cell* targetCell = findCell(&tracker, target);
+
+            if (known && (targetCell != NULL || tracker.zeroed)) {
+                // the trip count and the cell are known, set the cell at the target
+                int offset = tracker.offset;
+                tracker.offset = target;
+                setCell(&tracker, (targetCell != NULL ? targetCell->value : 0) + value * operands[i], 1);
+                tracker.offset += offset - target;
+            }
+            else if (known && ((value * operands[i]) & 0xFF) != 0) {
+                // the trip count is known, add to the cell at the target
+                emitMove(&tracker, target);
+                emitOperation(&tracker, DATA, (value * operands[i]) & 0xFF, 0);
+            }
+            else if (!known) {
+                // the cell at the target is changed at run time
+                if (targetCell != NULL) {
+                    if (targetCell->dirty) {
+                        writeCell(&tracker, targetCell);
+                    }
+                    *targetCell = tracker.cells[--tracker.count];
+                }
+                emitMove(&tracker, tracker.offset);
+                emitOperation(&tracker, ch, jumps[i], operands[i]);
+            }
+        }
+        else if (ch == AFFINE_LOOP && known && value == 0) {
+            // loop is never entered, skip it
+            continue;
+        }
+        else if (ch == AFFINE_LOOP && isAffineLoopKnown(&tracker, i)) {
+            // the loop runs on known cells, evaluate it
+            int size = operands[i];
+            int offsets[MAX_LOOP_CELLS];
+            unsigned char cells[MAX_LOOP_CELLS] = { 0 };
+            readAffineOffsets(constants + jumps[i], size, offsets);
+            for (int j = 0; j < size; j++) {
+                Cell* affineCell = findCell(&tracker, tracker.offset + offsets[j]);
+                cells[j] = affineCell != NULL ? affineCell->value : 0;
+            }
+            applyAffineLoop(constants + jumps[i], size, cells);
+            for (int j = 0; j < size; j++) {
+                tracker.offset += offsets[j];
+                setCell(&tracker, cells[j], 1);
+                tracker.offset -= offsets[j];
+            }
+        }
+        else if ((ch == '[' || ch == IF_OPEN) && known && value == 0) {
+            // loop is never entered, skip it
+            i = jumps[i];
+        }
+        else {
+            // every other operation ends the basic block
+            flushCells(&tracker);
+            tracker.zeroed = 0;
+
+            if (ch == '[' || ch == IF_OPEN) {
+                stackPush(stack, tracker.size);
+                emitOperation(&tracker, ch, 0, 0);
+            }
+            else if (ch == ']' || ch == IF_CLOSE) {
+                // pop opening bracket and swap indexes in jump table
+                int x = stackPop(stack);
+                tracker.outJumps[x] = tracker.size;
+                emitOperation(&tracker, ch, x, 0);
+            }
+            else {
+                emitOperation(&tracker, ch, jumps[i], operands[i]);
+            }
+
+            // the current cell is zero when leaving loops and scans
+            if (ch == ']' || ch == IF_CLOSE || ch == SET_ZERO || ch == SCAN_ZERO_LEFT || ch == SCAN_ZERO_RIGHT) {
+                setCell(&tracker, 0, 0);
+            }
+        }
+    }
+
+    // write pending cell values
+    flushCells(&tracker);
+
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+
+    // replace pre-processed source with the propagated one
+    free(processed);
+    free(jumps);
+    free(operands);
+    processed = tracker.out;
+    jumps = tracker.outJumps;
+    operands = tracker.outOperands;
+    processedFileSize = tracker.size;
+}
+
+/**
+ * Check if the operation can be part of a run of updates.
+ */
+static inline int isRunOperation(char ch) {
+    return ch == DATA || ch == SET_ZERO || ch == SET_VALUE || ch == ADDRESS;
+}
+
+/**
+ * Combine runs of updates to nearby cells into a single update of a window of cells.
+ * A run is a sequence of +, -, set(value), and pointer movements updating
+ * at least MIN_RUN_CELLS cells within a span of MAX_RUN_SIZE cells.
+ * Each cell of the window is updated to (cell & keep) + add, where keep is
+ * 0 for cells set to a value and 255 for the others, so that the whole
+ * window can be updated at once with vector instructions.
+ * The add values of the window followed by its keep values are stored in constants.
+ */
+void combineRuns() {
+    unsigned char add[2 * MAX_RUN_SIZE + 1];
+    unsigned char keep[2 * MAX_RUN_SIZE + 1];
+    char touched[2 * MAX_RUN_SIZE + 1];
+    int capacity = constantsSize;
+
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    int i, index;
+    for (i = 0, index = 0; i < processedFileSize; i++, index++) {
+        char ch = processed[i];
+
+        if (isRunOperation(ch) && ch != ADDRESS) {
+            memset(add, 0, sizeof(add));
+            memset(keep, 255, sizeof(keep));
+            memset(touched, 0, sizeof(touched));
+
+            // find the longest run starting here
+            // offsets are relative to the pointer at the start of the run
+            int offset = 0, low = 0, high = 0, cells = 0;
+            int end = i, endOffset = 0;
+            for (int j = i; j < processedFileSize && j - i < MAX_RUN_SCAN && isRunOperation(processed[j]); j++) {
+                if (processed[j] == ADDRESS) {
+                    offset += jumps[j];
+                    if (offset > MAX_RUN_SIZE || offset < -MAX_RUN_SIZE) break;
+                    continue;
+                }
+
+                // stop before the window grows too large
+                int newLow = cells > 0 && low < offset ? low : offset;
+                int newHigh = cells > 0 && high > offset ? high : offset;
+                if (newHigh - newLow + 1 > MAX_RUN_SIZE) break;
+                low = newLow;
+                high = newHigh;
+
+                int cell = offset + MAX_RUN_SIZE;
+                if (processed[j] == DATA) {
+                    add[cell] += jumps[j];
+                }
+                else {
+                    add[cell] = processed[j] == SET_VALUE ? jumps[j] : 0;
+                    keep[cell] = 0;
+                }
+                if (!touched[cell]) {
+                    touched[cell] = 1;
+                    cells++;
+                }
+                end = j + 1;
+                endOffset = offset;
+            }
+
+            if (cells >= MIN_RUN_CELLS) {
+                int size = high - low + 1;
+
+                // store the window in constants
+                if (constantsSize + 2 * size > capacity) {
+                    capacity = 2 * (constantsSize + 2 * size);
+                    constants = (unsigned char*) realloc(constants, sizeof(unsigned char) * (capacity));
+                }
+                memcpy(constants + constantsSize, add + low + MAX_RUN_SIZE, size);
+                memcpy(constants + constantsSize + size, keep + low + MAX_RUN_SIZE, size);
+
+                // move to the start of the window, update it, and move to the end of the run
+                // a run has at least 2 * MIN_RUN_CELLS - 1 operations, so it never grows
+                if (low != 0) {
+                    processed[index] = ADDRESS;
+                    jumps[index++] = low;
+                }
+                processed[index] = UPDATE_RUN;
+                jumps[index] = constantsSize;
+                operands[index] = size;
+                if (endOffset != low) {
+                    processed[++index] = ADDRESS;
+                    jumps[index] = endOffset - low;
+                }
+
+                constantsSize += 2 * size;
+                i = end - 1;
+                continue;
+            }
+        }
+
+        if (ch == '[' || ch == IF_OPEN) {
+            // push opening bracket [ to stack
+            processed[index] = ch;
+            stackPush(stack, index);
+        }
+        else if (ch == ']' || ch == IF_CLOSE) {
+            // pop opening bracket and swap indexes in jump table
+            int x = stackPop(stack);
+            jumps[x] = index;
+            jumps[index] = x;
+            processed[index] = ch;
+        }
+        else {
+            processed[index] = ch;
+            jumps[index] = jumps[i];
+            operands[index] = operands[i];
+        }
+    }
+
+    // set size of pre-processed file
+    processedFileSize = index;
+
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+}
+
+/**
+ * Check if the operation at position opens a loop which only moves the pointer ( [>>>] ).
+ */
+static inline int isStrideScan(int position) {
+    return position + 2 < processedFileSize && processed[position] == '['
+        && processed[position + 1] == ADDRESS && processed[position + 2] == ']';
+}
+
+/**
+ * Fuse frequent operation sequences into superinstructions.
+ * Sequences were selected from a frequency census over the test programs.
+ * Fuses >+ +> >[-] >set(value) >[ >] [+> >[>>>] and the [-] ending a
+ * multiply loop (a >+ is any ADDRESS followed by DATA).
+ * Loops are re-linked since the pre-processed source shrinks.
+ * Closing of conditionals are removed as they are not needed by the interpreter.
+ */
+void fuseOperations() {
+    // create a stack for [ operators
+    stack = stackCreate(STACK_SIZE);
+
+    int i, index;
+    for (i = 0, index = 0; i < processedFileSize; i++, index++) {
+        // get one operation and the one following it
+        char ch = processed[i];
+        char ch2 = i + 1 < processedFileSize ? processed[i + 1] : -1;
+
+        if ((ch == ADDRESS && isStrideScan(i + 1)) || isStrideScan(i)) {
+            // a scan with a stride, moving by the operand first
+            int move = ch == ADDRESS ? jumps[i++] : 0;
+            processed[index] = ADDRESS_SCAN_ZERO;
+            operands[index] = move;
+            jumps[index] = jumps[i + 1];
+            i += 2;
+        }
+        else if (ch == MULTIPLY_ADD && ch2 == SET_ZERO) {
+            processed[index] = MULTIPLY_ADD_SET_ZERO;
+            operands[index] = operands[i];
+            jumps[index] = jumps[i];
+            i++;
+        }
+        else if (ch == ADDRESS && ch2 == DATA) {
+            processed[index] = ADDRESS_DATA;
+            operands[index] = jumps[i + 1];
+            jumps[index] = jumps[i];
+            i++;
+        }
+        else if (ch == DATA && ch2 == ADDRESS) {
+            processed[index] = DATA_ADDRESS;
+            operands[index] = jumps[i];
+            jumps[index] = jumps[i + 1];
+            i++;
+        }
+        else if (ch == ADDRESS && ch2 == SET_ZERO) {
+            processed[index] = ADDRESS_SET_ZERO;
+            jumps[index] = jumps[i];
+            i++;
+        }
+        else if (ch == ADDRESS && ch2 == SET_VALUE) {
+            processed[index] = ADDRESS_SET_VALUE;
+            operands[index] = jumps[i + 1];
+            jumps[index] = jumps[i];
+            i++;
+        }
+        else if (ch == ADDRESS && ch2 == '[') {
+            processed[index] = ADDRESS_LOOP_OPEN;
+            operands[index] = jumps[i];
+            stackPush(stack, index);
+            i++;
+        }
+        else if (ch == ADDRESS && ch2 == ']') {
+            // pop opening bracket and swap indexes in jump table
+            int x = stackPop(stack);
+            processed[index] = ADDRESS_LOOP_CLOSE;
+            operands[index] = jumps[i];
+            jumps[x] = index;
+            jumps[index] = x;
+            i++;
+        }
+        else if (ch == '[') {
+            char ch3 = i + 2 < processedFileSize ? processed[i + 2] : -1;
+
+            // the following +> is fused on the next iteration
+            processed[index] = (ch2 == DATA && ch3 == ADDRESS) ? LOOP_DATA_ADDRESS : ch;
+            stackPush(stack, index);
+        }
+        else if (ch == ']') {
+            // pop opening bracket and swap indexes in jump table
+            int x = stackPop(stack);
+            jumps[x] = index;
+            jumps[index] = x;
+            processed[index] = ch;
+        }
+        else if (ch == IF_OPEN) {
+            processed[index] = ch;
+            stackPush(stack, index);
+        }
+        else if (ch == IF_CLOSE) {
+            // jump to the operation following the conditional
+            int x = stackPop(stack);
+            jumps[x] = index - 1;
+            index--;
+        }
+        else {
+            processed[index] = ch;
+            jumps[index] = jumps[i];
+            operands[index] = operands[i];
+        }
+    }
+
+    // set size of pre-processed file
+    processedFileSize = index;
+
+    // free stack
+    stackFree(stack);
+    stack = NULL;
+}
+
+/**
+ * Get the current wall clock time in seconds.
+ */
+double currentTime() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * An optimization pass over the pre-processed source.
+ */
+typedef struct Pass {
+    const char* name;
+    int level;              // lowest optimization level running the pass
+    int interpreterOnly;    // pass produces operations only the interpreter handles
+    void (*run)();          // NULL if run while pre-processing the source
+} Pass;
+
+// optimization passes in the order they are run, indexed by PASS_ constants
+static const Pass passes[PASS_COUNT] = {
+    { "compact",        1, 0, NULL },
+    { "idioms",         1, 0, initIdioms },
+    { "loops",          2, 0, evaluateLoops },
+    { "conditionals",   2, 0, initConditionals },
+    { "constants",      2, 0, propagateConstants },
+    { "runs",           2, 0, combineRuns },
+    { "fuse",           3, 1, fuseOperations }
+};
+
+/**
+ * Enable the optimization passes of an optimization level.
+ */
+void initPasses(int level) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        passEnabled[i] = passes[i].level <= level;
+    }
+}
+
+/**
+ * Enable only the optimization passes in a comma separated list of names.
+ * Returns 0 if a name is not recognized.
+ */
+int initPassList(const char* list) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        passEnabled[i] = 0;
+    }
+
+    while (*list != '\0') {
+        int length = strcspn(list, ",");
+        int found = 0;
+        for (int i = 0; i < PASS_COUNT; i++) {
+            if ((int) strlen(passes[i].name) == length && strncmp(passes[i].name, list, length) == 0) {
+                passEnabled[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found && length > 0) {
+            return 0;
+        }
+        list += length;
+        if (*list == ',') list++;
+    }
+    return 1;
+}
+
+/**
+ * Report the time taken by an optimization pass and its effect if requested.
+ */
+void reportPass(const char* name, double seconds, int before, int after) {
+    if (optReportFlag) {
+        fprintf(stderr, "Pass %-14s %10.3f ms %12d -> %d operations\n", name, seconds * 1e3, before, after);
+    }
+}
+
+/**
+ * Report the compact pass which is run while pre-processing the source.
+ */
+void reportCompactPass(double seconds) {
+    if (optReportFlag && passEnabled[PASS_COMPACT]) {
+        int before = 0;
+        for (int i = 0; i < fileSize; i++) {
+            if (isOperator(source[i])) before++;
+        }
+        reportPass(passes[PASS_COMPACT].name, seconds, before, processedFileSize);
+    }
+}
+
+/**
+ * Run the enabled optimization passes in order.
+ * Passes producing operations only the interpreter handles are run separately.
+ */
+void runPasses(int interpreterOnly) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if (passEnabled[i] && passes[i].run != NULL && passes[i].interpreterOnly == interpreterOnly) {
+            int before = processedFileSize;
+            TraceMark mark = beginTrace();
+            double start = currentTime();
+            passes[i].run();
+            endTrace(&mark, passes[i].name, "pass");
+            reportPass(passes[i].name, currentTime() - start, before, processedFileSize);
+        }
+    }
+}
+
+/**
+ * Report the pre-processing throughput if benchmarking.
+ */
+void reportPreprocessing(double seconds, int threads) {
+    if (benchmarkFlag) {
+        fprintf(stderr, "Pre-processed %d characters into %d operations in %.3f s (%.1f MB/s, %d threads)\n",
+                fileSize, processedFileSize, seconds, fileSize / 1e6 / (seconds > 0 ? seconds : 1e-9), threads);
+    }
 }
 
 /**
@@ -317,6 +1573,26 @@ char* generateCFilePath(char* filePath) {
     return cFilePath;
 }
 
+/**
+ * Generate the C file path of a translation unit.
+ * The first unit is the C file path, the others are numbered.
+ */
+char* generateCUnitFilePath(char* filePath, int unit) {
+    if (unit == 0) {
+        return generateCFilePath(filePath);
+    }
+
+    int length = strlen(filePath);
+
+    char* cFilePath = (char*) malloc(sizeof(char) * (length + 16));
+
+    strcpy(cFilePath, filePath);
+
+    sprintf(cFilePath + length - 2, "%d.c", unit);
+
+    return cFilePath;
+}
+
 /**
  * Generate the executable file path.
  */
@@ -333,60 +1609,329 @@ char* generateExecutableFilePath(char* filePath) {
 }
 
 /**
- * Execute the brainfuck source code.
+ * Initialize memory.
+ * Memory is reserved but not committed, pages are committed and zeroed
+ * by the operating system when first touched, so large memory sizes only
+ * cost the cells actually used.
+ * Without memory mapping, memory is allocated and zeroed at once instead.
  */
-void execute(char* filePath) {
-    // initialize memory and fill with zeros
-    memory = (unsigned char*) malloc(sizeof(unsigned char) * (MEMORY_SIZE));
-    memset(memory, 0, MEMORY_SIZE);
+void initMemory() {
+#ifdef POSIX_SYSTEM
+    void* reserved = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 
-    // load source file
-    loadFile(filePath);
+    if (reserved == MAP_FAILED) {
+        // display error message and exit
+        fprintf(stderr, "Failed to reserve memory of size %d\n", MEMORY_SIZE);
+        exit(1);
+    }
 
-    // initialize file jumps for optimization
-    initJumps();
+    memory = (unsigned char*) reserved;
+    memoryPageSize = sysconf(_SC_PAGESIZE);
+    memoryPageCount = (MEMORY_SIZE + memoryPageSize - 1) / memoryPageSize;
+#else
+    memory = (unsigned char*) calloc(MEMORY_SIZE, sizeof(unsigned char));
 
-    // for each character do operation
+    if (memory == NULL) {
+        // display error message and exit
+        fprintf(stderr, "Failed to allocate memory of size %d\n", MEMORY_SIZE);
+        exit(1);
+    }
+#endif
+}
+
+/**
+ * Find the pages of memory which were ever touched, including those swapped out since.
+ * Sets touched[i] to 1 if page i was touched, and to 0 otherwise.
+ * Uses only system calls, so that it can run in a forked process.
+ * Returns 0 if touched pages cannot be found on this system.
+ */
+int findTouchedPages(unsigned char* touched) {
+#ifdef __linux__
+    // every page has an entry in pagemap, with bit 63 set if present and bit 62 if swapped
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    unsigned long long entries[512];
+    long first = (unsigned long) memory / memoryPageSize;
+    for (long i = 0; i < memoryPageCount; i += 512) {
+        long count = memoryPageCount - i < 512 ? memoryPageCount - i : 512;
+        ssize_t length = sizeof(unsigned long long) * count;
+        if (pread(fd, entries, length, (first + i) * sizeof(unsigned long long)) != length) {
+            close(fd);
+            return 0;
+        }
+        for (long j = 0; j < count; j++) {
+            touched[i + j] = (entries[j] >> 62) != 0;
+        }
+    }
+
+    close(fd);
+    return 1;
+#else
+    (void) touched;
+    return 0;
+#endif
+}
+
+/**
+ * Report the memory touched by the program if benchmarking.
+ * The lowest and highest touched cells are those of the lowest and highest touched pages.
+ */
+void reportMemory() {
+    if (benchmarkFlag) {
+        unsigned char* touched = (unsigned char*) malloc(sizeof(unsigned char) * (memoryPageCount));
+
+        if (findTouchedPages(touched)) {
+            long count = 0, lowest = -1, highest = -1;
+            for (long i = 0; i < memoryPageCount; i++) {
+                if (touched[i]) {
+                    count++;
+                    lowest = lowest == -1 ? i : lowest;
+                    highest = i;
+                }
+            }
+
+            if (count == 0) {
+                fprintf(stderr, "Touched 0 of %ld memory pages\n", memoryPageCount);
+            }
+            else {
+                long end = (highest + 1) * memoryPageSize < MEMORY_SIZE ? (highest + 1) * memoryPageSize : MEMORY_SIZE;
+                fprintf(stderr, "Touched %ld of %ld memory pages, between cells %ld and %ld of %d\n",
+                        count, memoryPageCount, lowest * memoryPageSize, end - 1, MEMORY_SIZE);
+            }
+        }
+        else {
+            fprintf(stderr, "Touched memory pages are not known on this system\n");
+        }
+
+        free(touched);
+    }
+}
+
+/**
+ * Run the program, replaying cached results of memoized loops.
+ * It is kept out of execute(), as gcc optimizes every dispatch loop of a
+ * function worse the more of them there are.
+ * Operations are always counted, for the cost of loops.
+ */
+__attribute__((noinline)) void runMemoized() {
     char ch;
     while ((ch = readChar()) != -1) {
-        doOperation(ch);
+        doMemoizedOperation(ch);
     }
+    dispatchedOperations = memoOperations;
 }
 
 /**
- * Translate the brainfuck source code into C code.
+ * Execute the brainfuck source code.
  */
-void translate(char* filePath) {
-    // initialize memory and fill with zeros
-    memory = (unsigned char*) malloc(sizeof(unsigned char) * (MEMORY_SIZE));
-    memset(memory, 0, MEMORY_SIZE);
+void execute(char* filePath) {
+    // initialize memory
+    initMemory();
 
     // load source file
+    TraceMark mark = beginTrace();
     loadFile(filePath);
+    endTrace(&mark, "loadFile", "phase");
 
     // initialize file jumps for optimization
-    initJumps();
+    mark = beginTrace();
+    double start = currentTime();
+    int threads = initJumps();
+    endTrace(&mark, "initJumps", "phase");
+    reportPreprocessing(currentTime() - start, threads);
+    reportCompactPass(currentTime() - start);
+
+    // run optimization passes
+    runPasses(0);
+
+    // the native program runs from the start to the end at once
+    // and writes its output directly
+    if (nativeFlag && (checkpointPath != NULL || resumePath != NULL || pipelineFlag)) {
+        fprintf(stderr, "The program is interpreted when checkpointing, resuming, or in a pipeline.\n");
+    }
+    int native = 0;
+    if (nativeFlag && checkpointPath == NULL && resumePath == NULL && !pipelineFlag) {
+        mark = beginTrace();
+        native = initNative();
+        endTrace(&mark, "initNative", "phase");
+    }
 
-    // generate C file path
-    cFilePath = generateCFilePath(filePath);
+    // compiled loops are translated from operations which are not fused
+    // checkpoints are only taken between interpreted operations
+    // and pipeline stages only pass on output of interpreted operations
+    if (tieredFlag && (checkpointPath != NULL || pipelineFlag)) {
+        fprintf(stderr, "Hot loops are interpreted when checkpointing or in a pipeline.\n");
+    }
+    int tiered = !native && tieredFlag && checkpointPath == NULL && !pipelineFlag && initTiers();
+
+    // memoized loops are found in operations which are not fused
+    if (memoizeFlag && (tiered || checkpointPath != NULL)) {
+        fprintf(stderr, "Loops are not memoized in tiered execution or when checkpointing.\n");
+    }
+    int memoized = !native && memoizeFlag && !tiered && checkpointPath == NULL;
+    if (memoized) {
+        initMemo();
+    }
 
-    // initialize the Brainfuck to C translator
-    initTranslator(cFilePath);
+    if (!native && !tiered && !memoized) {
+        // run optimization passes for the interpreter
+        runPasses(1);
+    }
+
+    // resume execution from a checkpoint
+    if (resumePath != NULL) {
+        resumeCheckpoint(resumePath);
+    }
+
+    // take checkpoints periodically and on SIGUSR1
+    if (checkpointPath != NULL) {
+        initCheckpoints();
+    }
 
-    // write the common header for C file
-    writeCHeader();
+    // start measuring execution
+    mark = beginTrace();
+    start = currentTime();
+    if (statsFlag) {
+        startStats();
+    }
 
-    // for each character do translation
+    // for each character do operation
+    // operations are only counted when measuring statistics, and never natively
+    // checkpoint requests are only checked when checkpointing
     char ch;
-    while ((ch = readChar()) != -1) {
-        doTranslate(ch);
+    if (native) {
+        runNative();
+        dispatchedOperations = -1;
+    }
+    else if (tiered && statsFlag) {
+        while ((ch = readChar()) != -1) {
+            doTieredOperation(ch);
+            dispatchedOperations++;
+        }
+    }
+    else if (tiered) {
+        while ((ch = readChar()) != -1) {
+            doTieredOperation(ch);
+        }
+    }
+    else if (memoized) {
+        runMemoized();
+    }
+    else if (checkpointPath != NULL) {
+        while ((ch = readChar()) != -1) {
+            doOperation(ch);
+            dispatchedOperations++;
+            if (checkpointRequested) {
+                writeCheckpoint();
+            }
+        }
     }
+    else if (statsFlag) {
+        while ((ch = readChar()) != -1) {
+            doOperation(ch);
+            dispatchedOperations++;
+        }
+    }
+    else {
+        while ((ch = readChar()) != -1) {
+            doOperation(ch);
+        }
+    }
+
+    endTrace(&mark, "run", "phase");
+
+    // report statistics of execution
+    if (statsFlag) {
+        stopStats();
+        reportStats();
+    }
+
+    // report execution time if benchmarking
+    if (benchmarkFlag) {
+        fprintf(stderr, "Executed program of %d operations in %.3f s\n", processedFileSize, currentTime() - start);
+    }
+
+    // report memory touched if benchmarking
+    reportMemory();
+
+    // report the cache of loop results if benchmarking
+    if (memoized && benchmarkFlag) {
+        reportMemo();
+    }
+}
+
+/**
+ * Serve the brainfuck source code over TCP, one execution per connection.
+ */
+void serve(char* filePath, int port) {
+    // load source file
+    TraceMark mark = beginTrace();
+    loadFile(filePath);
+    endTrace(&mark, "loadFile", "phase");
+
+    // initialize file jumps for optimization
+    mark = beginTrace();
+    double start = currentTime();
+    int threads = initJumps();
+    endTrace(&mark, "initJumps", "phase");
+    reportPreprocessing(currentTime() - start, threads);
+    reportCompactPass(currentTime() - start);
+
+    // run optimization passes, including those for the interpreter
+    runPasses(0);
+    runPasses(1);
+
+    // serve executions until stopped
+    runServer(port);
+}
+
+/**
+ * Translate the brainfuck source code into C code.
+ */
+void translate(char* filePath) {
+    // load source file
+    TraceMark mark = beginTrace();
+    loadFile(filePath);
+    endTrace(&mark, "loadFile", "phase");
 
-    // write the common footer for C file
-    writeCFooter();
+    // initialize file jumps for optimization
+    mark = beginTrace();
+    double start = currentTime();
+    int threads = initJumps();
+    endTrace(&mark, "initJumps", "phase");
+    reportPreprocessing(currentTime() - start, threads);
+    reportCompactPass(currentTime() - start);
+
+    // run optimization passes
+    runPasses(0);
+
+    // split the program into functions and C files
+    mark = beginTrace();
+    planCFunctions();
+
+    // translate each C file
+    for (int unit = 0; unit < cUnitCount; unit++) {
+        // generate C file path
+        cFilePath = generateCUnitFilePath(filePath, unit);
+
+        // initialize the Brainfuck to C translator
+        initTranslator(cFilePath);
+
+        // write the functions of the C file
+        writeCUnit(unit);
+
+        // close the C file
+        closeTranslator();
+        free(cFilePath);
+        cFilePath = NULL;
+    }
 
     // clean up the Brainfuck to C translator
     cleanupTranslator();
+    endTrace(&mark, "translate", "phase");
 }
 
 /**
@@ -398,16 +1943,101 @@ int executeCommand(const char *cmd) {
     sprintf(command, "%s 2>&1 | \"%s\" --null", cmd, programExecutablePath);
 
     // execute the command
+    TraceMark mark = beginTrace();
     int out = system(command);
+    endTrace(&mark, cmd, "command");
 
     // return success or error
     return out == 0;
 }
 
+/**
+ * A C file to be compiled to an object file.
+ */
+typedef struct CompileJob {
+    char* cPath;
+    char* objectPath;
+    const char* flags;
+    int result;
+} CompileJob;
+
+/**
+ * Thread entry point to compile a C file to an object file.
+ */
+void* compileUnitThread(void* arg) {
+    CompileJob* job = (CompileJob*) arg;
+
+    // build command string
+    char command[strlen("gcc -c%s \"%s\" -o \"%s\"") + strlen(job->flags) + strlen(job->cPath) + strlen(job->objectPath)];
+    sprintf(command, "gcc -c%s \"%s\" -o \"%s\"", job->flags, job->cPath, job->objectPath);
+
+    job->result = executeCommand(command);
+    return NULL;
+}
+
+/**
+ * Compile the C files of a translated program in parallel, and link them.
+ * Flags are empty or start with a space.
+ * Returns 0 if the program could not be compiled.
+ */
+int compileUnits(char* filePath, char* outputPath, const char* compileFlags, const char* linkFlags) {
+    CompileJob jobs[cUnitCount];
+    pthread_t workers[cUnitCount];
+    int started[cUnitCount];
+    size_t linkLength = strlen("gcc -o \"\"") + strlen(outputPath) + strlen(linkFlags);
+
+    // compile each C file in its own thread
+    for (int i = 0; i < cUnitCount; i++) {
+        jobs[i].cPath = generateCUnitFilePath(filePath, i);
+        jobs[i].objectPath = strdup(jobs[i].cPath);
+        jobs[i].objectPath[strlen(jobs[i].objectPath) - 1] = 'o';
+        jobs[i].flags = compileFlags;
+        jobs[i].result = 0;
+        linkLength += strlen(jobs[i].objectPath) + 3;
+
+        started[i] = pthread_create(&workers[i], NULL, compileUnitThread, &jobs[i]) == 0;
+        if (!started[i]) {
+            compileUnitThread(&jobs[i]);
+        }
+    }
+
+    // wait for all C files
+    int result = 1;
+    for (int i = 0; i < cUnitCount; i++) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        }
+        result = result && jobs[i].result;
+    }
+
+    // link the object files
+    if (result) {
+        char command[linkLength + 1];
+        int length = sprintf(command, "gcc");
+        for (int i = 0; i < cUnitCount; i++) {
+            length += sprintf(command + length, " \"%s\"", jobs[i].objectPath);
+        }
+        sprintf(command + length, " -o \"%s\"%s", outputPath, linkFlags);
+
+        result = executeCommand(command);
+    }
+
+    // remove the object files
+    for (int i = 0; i < cUnitCount; i++) {
+        remove(jobs[i].objectPath);
+        free(jobs[i].cPath);
+        free(jobs[i].objectPath);
+    }
+
+    return result;
+}
+
 /**
  * Compile the generated C code.
  */
 void compile(char* filePath) {
+    TraceMark mark = beginTrace();
+
     // generate C file path
     cFilePath = generateCFilePath(filePath);
 
@@ -420,12 +2050,21 @@ void compile(char* filePath) {
         exit(1);
     }
 
-    // build command string
-    char command[strlen("gcc \"%s\" -o \"%s\"") + strlen(cFilePath) + strlen(exeFilePath)];
-    sprintf(command, "gcc \"%s\" -o \"%s\"", cFilePath, exeFilePath);
-
     // compile the program
-    int commandOut = executeCommand(command);
+    // freestanding programs are linked statically without libc, and stripped
+    const char* cFlags = freestandingFlag ? " " FREESTANDING_CFLAGS : "";
+    const char* ldFlags = freestandingFlag ? " " FREESTANDING_LDFLAGS : "";
+    int commandOut;
+    if (cUnitCount == 1) {
+        // build command string
+        char command[strlen("gcc%s \"%s\" -o \"%s\"%s") + strlen(cFlags) + strlen(cFilePath) + strlen(exeFilePath) + strlen(ldFlags)];
+        sprintf(command, "gcc%s \"%s\" -o \"%s\"%s", cFlags, cFilePath, exeFilePath, ldFlags);
+
+        commandOut = executeCommand(command);
+    }
+    else {
+        commandOut = compileUnits(filePath, exeFilePath, cFlags, ldFlags);
+    }
 
     // free cFilePath
     free(cFilePath);
@@ -435,6 +2074,8 @@ void compile(char* filePath) {
     free(exeFilePath);
     exeFilePath = NULL;
 
+    endTrace(&mark, "compile", "phase");
+
     // build failed
     if (!commandOut) {
         fprintf(stderr, "Failed to compile program.");
@@ -483,6 +2124,9 @@ int endsWithIgnoreCase(const char *str, const char *suffix) {
  * Free all resources to prevent memory leaks.
  */
 void clean() {
+    // clean tiered execution first, as the compiler thread reads the pre-processed source
+    cleanupTiers();
+
     // free source
     if (source != NULL) {
         free(source);
@@ -501,9 +2145,25 @@ void clean() {
         jumps = NULL;
     }
 
+    // free operands
+    if (operands != NULL) {
+        free(operands);
+        operands = NULL;
+    }
+
+    // free constants
+    if (constants != NULL) {
+        free(constants);
+        constants = NULL;
+    }
+
     // free memory
     if (memory != NULL) {
+#ifdef POSIX_SYSTEM
+        munmap(memory, MEMORY_SIZE);
+#else
         free(memory);
+#endif
         memory = NULL;
     }
 
@@ -513,8 +2173,26 @@ void clean() {
         stack = NULL;
     }
 
+    // clean memoization of loops
+    cleanupMemo();
+
+    // unload the native program
+    cleanupNative();
+
+    // clean performance counters
+    cleanupStats();
+
+    // wait for the last checkpoint
+    cleanupCheckpoints();
+
+    // close pipeline channels
+    cleanupPipeline();
+
     // clean translator
     cleanupTranslator();
+
+    // write the trace of phases
+    cleanupTrace();
 }
 
 /**
@@ -529,17 +2207,52 @@ void printHelp() {
     printf("    %s\n\n", VERSION);
 
     printf("Usage:\n");
-    printf("    brainfuck [options] <source file path>\n\n");
+    printf("    brainfuck [options] <source file path>\n");
+    printf("    brainfuck [options] --pipeline <source file path> <source file path> ...\n\n");
 
     printf("Options:\n");
     printf("    -c\n");
     printf("    --compile     Translate to C and compile to machine code [requires GCC]\n\n");
     printf("    -x\n");
     printf("    --translate   Translate to C but do not compile\n\n");
+    printf("    --freestanding\n");
+    printf("                  Translate to C which does not use libc, with buffered input and output\n");
+    printf("                  using system calls, and compile it statically [Linux on x86-64 or AArch64]\n\n");
+    printf("    --native      Compile to a shared object and run it in this process [requires GCC]\n");
+    printf("                  [shared objects are cached by the hash of the translated C code]\n\n");
+    printf("    -j\n");
+    printf("    --jit         Interpret and compile hot loops to machine code in the background [requires GCC]\n\n");
+    printf("    --memoize     Replay cached results of loops without input or output when they are run\n");
+    printf("                  again with the same cells [cache hits and misses are reported with -b]\n\n");
     printf("    -m\n");
     printf("    --memory      Size of interpreter memory [must be equal to or above %d]\n\n", MIN_MEMORY_SIZE);
     printf("    -s\n");
     printf("    --stack       Size of interpreter stack [must be equal to or above %d]\n\n", MIN_STACK_SIZE);
+    printf("    -p\n");
+    printf("    --parallel    Number of threads to pre-process large source files [must be equal to or above %d]\n\n", MIN_THREAD_COUNT);
+    printf("    -b\n");
+    printf("    --benchmark   Report pre-processing throughput and execution time\n\n");
+    printf("    --stats       Report hardware performance counter statistics of execution\n\n");
+    printf("    --checkpoint <file>\n");
+    printf("                  Periodically and on SIGUSR1, save the state of execution to the file\n\n");
+    printf("    --checkpoint-interval <seconds>\n");
+    printf("                  Seconds between checkpoints [default is %d]\n\n", DEFAULT_CHECKPOINT_INTERVAL);
+    printf("    --resume <file>\n");
+    printf("                  Resume execution from a checkpoint of the same program and options\n\n");
+    printf("    -O0, -O1, -O2, -O3\n");
+    printf("                  Optimization level [default is -O3]\n\n");
+    printf("    --passes=<pass,...>\n");
+    printf("                  Run only the listed optimization passes, in their usual order\n");
+    printf("                  [compact, idioms, loops, conditionals, constants, runs, fuse]\n\n");
+    printf("    --opt-report  Report time taken and operations before and after each optimization pass\n\n");
+    printf("    --trace=<file>\n");
+    printf("                  Write the wall clock and CPU time of each phase and external command\n");
+    printf("                  to the file in Chrome trace event format, and summarize it\n\n");
+    printf("    --serve <port>\n");
+    printf("                  Serve the program over TCP, running it for each connection with the\n");
+    printf("                  connection as its input and output\n\n");
+    printf("    --pipeline    Run each source file as a stage of a pipeline, with the output of each\n");
+    printf("                  stage as the input of the next\n\n");
     printf("    -v\n");
     printf("    --version     Show product version and exit\n\n");
     printf("    -i\n");
@@ -559,8 +2272,16 @@ int main(int argc, char** argv) {
     // by default, execute
     int compileFlag = 0, translateFlag = 0;
 
-    // variable to extract and store source file path from command line arguments
+    // port to serve on, or 0 to execute once
+    int port = 0;
+
+    // by default, run all optimization passes
+    initPasses(MAX_OPTIMIZATION_LEVEL);
+
+    // variables to extract and store source file paths from command line arguments
     char* path = NULL;
+    char* paths[argc];
+    int pathCount = 0;
 
     // extract parameters and source file path from command line arguments
     for (int i = 1; i < argc; i++) {
@@ -601,6 +2322,21 @@ int main(int argc, char** argv) {
             translateFlag = 1;
         }
 
+        // check if it is to be translated to C without libc
+        else if (equals(argv[i], "--freestanding")) {
+            freestandingFlag = 1;
+        }
+
+        // check if it is to be compiled and run in this process
+        else if (equals(argv[i], "--native")) {
+            nativeFlag = 1;
+        }
+
+        // check if hot loops are to be compiled in the background
+        else if (equals(argv[i], "-j") || equals(argv[i], "--jit")) {
+            tieredFlag = 1;
+        }
+
         // check if memory size is to be customized
         else if (equals(argv[i], "-m") || equals(argv[i], "--memory")) {
             int memorySz = 0;
@@ -633,10 +2369,124 @@ int main(int argc, char** argv) {
             }
         }
 
-        // get the path to source file (only once)
-        else if (path == NULL) {
+        // check if number of pre-processing threads is to be changed
+        else if (equals(argv[i], "-p") || equals(argv[i], "--parallel")) {
+            int threadCnt = 0;
+            if (i + 1 < argc) {
+                threadCnt = atoi(argv[++i]);
+            }
+            if (threadCnt >= MIN_THREAD_COUNT) {
+                THREAD_COUNT = threadCnt;
+            }
+            else {
+                fprintf(stderr, "Invalid thread count [must be at least %d]\n\n", MIN_THREAD_COUNT);
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if benchmark is to be reported
+        else if (equals(argv[i], "-b") || equals(argv[i], "--benchmark")) {
+            benchmarkFlag = 1;
+        }
+
+        // check if statistics are to be reported
+        else if (equals(argv[i], "--stats")) {
+            statsFlag = 1;
+        }
+
+        // check if loops are to be memoized
+        else if (equals(argv[i], "--memoize")) {
+            memoizeFlag = 1;
+        }
+
+        // check if checkpoints are to be taken
+        else if (equals(argv[i], "--checkpoint")) {
+            if (i + 1 < argc) {
+                checkpointPath = argv[++i];
+            }
+            else {
+                fprintf(stderr, "Path to checkpoint file not provided\n\n");
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if checkpoint interval is to be changed
+        else if (equals(argv[i], "--checkpoint-interval")) {
+            int interval = 0;
+            if (i + 1 < argc) {
+                interval = atoi(argv[++i]);
+            }
+            if (interval >= MIN_CHECKPOINT_INTERVAL) {
+                checkpointInterval = interval;
+            }
+            else {
+                fprintf(stderr, "Invalid checkpoint interval [must be at least %d]\n\n", MIN_CHECKPOINT_INTERVAL);
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if execution is to be resumed from a checkpoint
+        else if (equals(argv[i], "--resume")) {
+            if (i + 1 < argc) {
+                resumePath = argv[++i];
+            }
+            else {
+                fprintf(stderr, "Path to checkpoint file not provided\n\n");
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if optimization level is to be changed
+        else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '3' && argv[i][3] == '\0') {
+            initPasses(argv[i][2] - '0');
+        }
+
+        // check if optimization passes are to be selected
+        else if (strncmp(argv[i], "--passes=", strlen("--passes=")) == 0) {
+            if (!initPassList(argv[i] + strlen("--passes="))) {
+                fprintf(stderr, "Unknown optimization pass in: %s\n\n", argv[i]);
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if optimization report is to be displayed
+        else if (equals(argv[i], "--opt-report")) {
+            optReportFlag = 1;
+        }
+
+        // check if phases are to be traced
+        else if (strncmp(argv[i], "--trace=", strlen("--trace=")) == 0 && argv[i][strlen("--trace=")] != '\0') {
+            tracePath = argv[i] + strlen("--trace=");
+        }
+
+        // check if the program is to be served
+        else if (equals(argv[i], "--serve")) {
+            if (i + 1 < argc) {
+                port = atoi(argv[++i]);
+            }
+            if (port < 1 || port > 65535) {
+                fprintf(stderr, "Invalid port [must be between 1 and 65535]\n\n");
+                printHelp();
+                exit(1);
+            }
+        }
+
+        // check if source files are to be run as a pipeline
+        else if (equals(argv[i], "--pipeline")) {
+            pipelineFlag = 1;
+        }
 
-            path = argv[i];
+        // get the path to source file (only once, unless running a pipeline)
+        else if (path == NULL || pipelineFlag) {
+            if (path == NULL) {
+                path = argv[i];
+            }
+            paths[pathCount++] = argv[i];
         }
 
         // unknown parameter, display error
@@ -661,18 +2511,61 @@ int main(int argc, char** argv) {
         }
     }
 
-    // check if filename is standards compliant
-    if (!endsWithIgnoreCase(path, ".bf")) {
-        fprintf(stderr, "Invalid file name: %s\n", path);
-        fprintf(stderr, "File format not recognized [must end with \".bf\"]\n");
+    // check if filenames are standards compliant
+    for (int i = 0; i < pathCount; i++) {
+        if (!endsWithIgnoreCase(paths[i], ".bf")) {
+            fprintf(stderr, "Invalid file name: %s\n", paths[i]);
+            fprintf(stderr, "File format not recognized [must end with \".bf\"]\n");
+            exit(1);
+        }
+    }
+
+    // check if the program is translated
+    if (freestandingFlag && !compileFlag && !translateFlag) {
+        fprintf(stderr, "Freestanding program must be compiled or translated\n\n");
+        printHelp();
+        exit(1);
+    }
+
+    // check if the program is run natively
+    if (nativeFlag && (compileFlag || translateFlag || port != 0)) {
+        fprintf(stderr, "Native program cannot be compiled, translated, or served\n\n");
+        printHelp();
+        exit(1);
+    }
+
+    // check if the program can be served
+    if (port != 0 && (compileFlag || translateFlag || pipelineFlag || checkpointPath != NULL || resumePath != NULL)) {
+        fprintf(stderr, "Served program cannot be compiled, translated, pipelined, or checkpointed\n\n");
+        printHelp();
+        exit(1);
+    }
+
+    // check if the pipeline can be run
+    if (pipelineFlag && (compileFlag || translateFlag || checkpointPath != NULL || resumePath != NULL)) {
+        fprintf(stderr, "Pipeline cannot be compiled, translated, or checkpointed\n\n");
+        printHelp();
         exit(1);
     }
 
     // clean before exit
     atexit(clean);
 
-    // compile, translate, or execute
-    if (compileFlag) {
+    // start tracing phases
+    if (tracePath != NULL) {
+        initTrace();
+    }
+
+    // compile, translate, execute, serve, or run a pipeline
+    if (port != 0) {
+        // serve the brainfuck code to clients
+        serve(path, port);
+    }
+    else if (pipelineFlag) {
+        // execute each brainfuck source as a stage of the pipeline
+        runPipeline(paths, pathCount);
+    }
+    else if (compileFlag) {
         // translate the brainfuck code to C
         translate(path);
         // compile the translated C code
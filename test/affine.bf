@@ -0,0 +1,10 @@
+++                              Make cell 0 = 2
+[
+    > ++                        Make cell 1 = 2
+    [
+        > + > + > + > +         Add cell 1 to cells 2 to 5
+        <<<< -
+    ]
+    < -
+]
+>>> .                           Print cell 3 = 4